@@ -5,6 +5,7 @@
 
 # include "action_manager.hh"
 # include "action.hh"
+# include "tag_journal.hh"
 
 using namespace std;
 
@@ -13,5 +14,44 @@ namespace Astroid {
     return false;
   }
 
+  void Action::cancel () {
+    cancel_requested = true;
+  }
+
+  bool Action::cancelled () {
+    return cancel_requested;
+  }
+
+  void Action::journal (TagJournal *) {
+  }
+
+  const char * Action::lane_name (Lane l) {
+    switch (l) {
+      case INTERACTIVE: return "interactive";
+      case BULK:        return "bulk";
+      case BACKGROUND:  return "background";
+      default:          return "unknown";
+    }
+  }
+
+  bool Action::conflicts (refptr<Action> other) {
+    if (!threads_known || !other->threads_known) return true;
+
+    /* look up the threads of the smaller set in the larger */
+    auto & small = (threads.size () <= other->threads.size ()) ? threads : other->threads;
+    auto & large = (threads.size () <= other->threads.size ()) ? other->threads : threads;
+
+    for (auto & t : small) {
+      if (large.count (t)) return true;
+    }
+
+    return false;
+  }
+
+  void Action::unjournal (TagJournal * j) {
+    j->done (journaled);
+    journaled.clear ();
+  }
+
 }
 
@@ -2,6 +2,10 @@
 
 # include <glibmm.h>
 # include <vector>
+# include <string>
+# include <unordered_set>
+# include <atomic>
+# include <chrono>
 
 # include "proto.hh"
 
@@ -16,7 +20,65 @@ namespace Astroid {
 
       virtual void emit (Db *) = 0;
 
+      /* actions on many items report their progress and stop at the next
+       * item when cancelled. these may be used from any thread. */
+      std::atomic<unsigned int> progress { 0 };
+      std::atomic<unsigned int> total    { 0 };
+      std::atomic<bool>         finished { false };
+
+      void cancel ();
+      bool cancelled ();
+
+      /* called on the gui thread when the action is queued (also for
+       * undo): actions that change tags write the changes to the journal
+       * and show them on the in-memory items before they are done. */
+      virtual void journal (TagJournal *);
+
+      /* the action was removed from the queue before it was done */
+      virtual void unjournal (TagJournal *);
+
+      /* the action worker does the interactive actions first, then the
+       * bulk actions and at last the background actions. */
+      enum Lane {
+        INTERACTIVE = 0,
+        BULK,
+        BACKGROUND,
+        LANES,
+      };
+
+      static const char * lane_name (Lane);
+
+      Lane lane = INTERACTIVE;
+
     protected:
+      /* the journal entries that are marked done when the action has been
+       * done */
+      std::vector<unsigned long> journaled;
+
+      std::atomic<bool> cancel_requested { false };
+
+      /* the threads changed by the action, set when it is queued. an action
+       * is only done before the actions queued earlier if the threads of
+       * both are known and none are changed by both. */
+      bool threads_known = false;
+      std::unordered_set<std::string> threads;
+
+      bool conflicts (refptr<Action>);
+
+      /* actions that are not interactive may do at most chunk items in a
+       * doit () or undo (), and set remaining if there are more. the action
+       * worker does the interactive actions queued in the meantime before
+       * it does the next chunk. */
+      unsigned int chunk = 0; // 0: all
+      bool remaining = false;
+
+      /* managed by the action worker */
+      unsigned long seq = 0;
+      bool running = false;
+      std::chrono::steady_clock::time_point queued;
+      std::chrono::steady_clock::time_point started;
+      double run_time = 0; // ms
+
       /* used when undoing, the action_worker will undo the action
        * without adding it to the doneactions */
       bool in_undo = false;
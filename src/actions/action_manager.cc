@@ -1,17 +1,37 @@
 
 # include <iostream>
 # include <vector>
+# include <chrono>
+# include <algorithm>
+# include <unordered_set>
 
 # include "astroid.hh"
 # include "action_manager.hh"
 # include "action.hh"
+# include "tag_journal.hh"
+# include "config.hh"
 # include "db.hh"
 
 using namespace std;
 
 namespace Astroid {
   void ActionManager::doit (refptr<Action> action) {
+    /* tag changes are shown right away, and written to the db by the
+     * action worker */
+    action->journal (journal);
+    if (!action->journaled.empty ()) emit_tags_applied ();
+
+    action->chunk = (action->lane != Action::INTERACTIVE) ? chunk_size : 0;
+
+    action->queued   = chrono::steady_clock::now ();
+    action->started  = chrono::steady_clock::time_point ();
+    action->run_time = 0;
+
     std::lock_guard<std::mutex> lk (actions_m);
+
+    /* an undo keeps the number of the action */
+    if (!action->in_undo) action->seq = next_seq++;
+
     actions.push_back (action);
     actions_cv.notify_one ();
   }
@@ -21,51 +41,144 @@ namespace Astroid {
     doit (action);
   }
 
+  std::deque<refptr<Action>>::iterator ActionManager::next_action () {
+    for (int l = 0; l < Action::LANES; l++) {
+      for (auto it = actions.begin (); it != actions.end (); it++) {
+        if ((*it)->running || (*it)->lane != l) continue;
+
+        /* the first action of the lane may pass the actions queued before
+         * it if they do not change the same threads */
+        bool pass = true;
+
+        for (auto b = actions.begin (); b != it; b++) {
+          if (!(*b)->running && (*it)->conflicts (*b)) {
+            pass = false;
+            break;
+          }
+        }
+
+        if (pass) return it;
+        break;
+      }
+    }
+
+    return actions.end ();
+  }
+
+  void ActionManager::remove_action (refptr<Action> a) {
+    auto it = find (actions.begin (), actions.end (), a);
+    if (it != actions.end ()) actions.erase (it);
+  }
+
   void ActionManager::action_worker () {
+    /* set when the db could not be opened for the journaled actions */
+    bool retry = false;
 
     while (run) {
       std::unique_lock<std::mutex> lk (actions_m);
-      actions_cv.wait (lk, [&] { return (!actions.empty () || !run); });
 
-      /* lock emitter now, so that it does not start opening a
-       * read-only db while the read-write db is open */
-      lock_guard<std::mutex> elk (toemit_m);
+      if (retry) {
+        retry = false;
+        actions_cv.wait_for (lk, std::chrono::seconds (retry_delay), [&] { return !run; });
+      }
 
+      actions_cv.wait (lk, [&] { return (!actions.empty () || !run); });
 
       while (!actions.empty ()) {
-        refptr<Action> a = actions.front ();
-        actions.pop_front ();
+        auto it = next_action ();
+        if (it == actions.end ()) break;
+
+        refptr<Action> a = *it;
+
+        /* the interactive journaled actions that can be done next are
+         * written with the same db, the other lanes are done one chunk at
+         * the time. */
+        std::vector<refptr<Action>> batch = { a };
+        a->running = true;
+
+        if (!a->journaled.empty () && a->lane == Action::INTERACTIVE) {
+          for (auto n = next_action (); n != actions.end (); n = next_action ()) {
+            if ((*n)->journaled.empty () || (*n)->lane != Action::INTERACTIVE) break;
+
+            (*n)->running = true;
+            batch.push_back (*n);
+          }
+        }
 
-        /* allow new actions to be queued while waiting for db */
+        auto now = chrono::steady_clock::now ();
+        for (auto & b : batch) {
+          if (b->started == chrono::steady_clock::time_point ()) b->started = now;
+        }
+
+        /* allow new actions to be queued while the batch is done */
         lk.unlock ();
 
-        Db * db;
-        std::unique_lock<std::mutex> rw_lock;
+        /* lock emitter now, so that it does not start opening a
+         * read-only db while the read-write db is open */
+        std::unique_lock<std::mutex> elk (toemit_m);
 
-        if (a->need_db) {
-          if (a->need_db_rw) {
-            db = new Db (Db::DbMode::DATABASE_READ_WRITE);
+        Db * db = NULL;
+        unsigned long lock_id = 0;
 
+        try {
+          if (a->need_db) {
+            if (a->need_db_rw) {
+              db = new Db (Db::DbMode::DATABASE_READ_WRITE);
+
+            } else {
+              db = new Db (Db::DbMode::DATABASE_READ_ONLY);
+
+            }
           } else {
-            db = new Db (Db::DbMode::DATABASE_READ_ONLY);
+            if (a->need_db_rw) {
+              lock_id = Db::acquire_rw_lock ();
+            } else {
+              lock_id = Db::acquire_ro_lock ();
+            }
+          }
+        } catch (database_error &ex) {
+          if (a->journaled.empty ()) throw;
+
+          elk.unlock ();
+          lk.lock ();
+
+          /* the changes stay in the journal: try again later, or on the
+           * next start when closing */
+          LOG (error) << "actions: could not open db for " << batch.size () << " tag actions: " << ex.what ();
 
+          for (auto & b : batch) {
+            b->running = false;
+            if (!run) remove_action (b);
           }
-        } else {
-          if (a->need_db_rw) {
-            rw_lock = Db::acquire_rw_lock ();
-            db = NULL;
+
+          if (!run) continue;
+
+          retry = true;
+          break;
+        }
+
+        if (batch.size () > 1) {
+          LOG (debug) << "actions: writing " << batch.size () << " tag actions..";
+          notmuch_database_begin_atomic (db->nm_db);
+        }
+
+        for (auto & b : batch) {
+          auto t0 = chrono::steady_clock::now ();
+
+          b->remaining = false;
+
+          if (!b->in_undo) {
+            b->doit (db);
           } else {
-            Db::acquire_ro_lock ();
-            db = NULL;
+            b->undo (db);
           }
-        }
 
-        lk.lock ();
+          chrono::duration<double, std::milli> elapsed = chrono::steady_clock::now () - t0;
+          b->run_time += elapsed.count ();
+        }
 
-        if (!a->in_undo) {
-          a->doit (db);
-        } else {
-          a->undo (db);
+        if (batch.size () > 1) {
+          notmuch_database_end_atomic (db->nm_db);
         }
 
         if (a->need_db) {
@@ -73,22 +186,81 @@ namespace Astroid {
           delete db;
         } else {
           if (a->need_db_rw) {
-            Db::release_rw_lock (rw_lock);
+            Db::release_rw_lock (lock_id);
           } else {
-            Db::release_ro_lock ();
+            Db::release_ro_lock (lock_id);
           }
         }
 
-        if (!a->in_undo && a->undoable () && !a->skip_undo) {
-          doneactions.push_back (a);
+        lk.lock ();
+
+        bool emitting = false;
+
+        for (auto & b : batch) {
+          b->running = false;
+
+          /* the next chunk is done after the actions that can go before it */
+          if (b->remaining) continue;
+
+          remove_action (b);
+          b->finished = true;
+
+          /* written to the db now */
+          if (!b->journaled.empty ()) {
+            journal->done (b->journaled);
+            b->journaled.clear ();
+          }
+
+          add_stats (b);
+
+          if (!b->in_undo && b->undoable () && !b->skip_undo) {
+            doneactions.push_back (b);
+          }
+
+          if (emit) {
+            toemit.push (b);
+            emitting = true;
+          }
         }
 
-        if (emit) toemit.push (a);
+        elk.unlock ();
+
+        if (emitting) emit_ready ();
       }
+    }
+  }
 
-      lk.unlock ();
+  void ActionManager::add_stats (refptr<Action> a) {
+    /* actions_m must be held */
+    chrono::duration<double, std::milli> wait = a->started - a->queued;
 
-      emit_ready ();
+    LaneStats & st = lane_stats[a->lane];
+
+    st.count++;
+    st.wait_total += wait.count ();
+    st.wait_max    = max (st.wait_max, wait.count ());
+    st.run_total  += a->run_time;
+    st.run_max     = max (st.run_max, a->run_time);
+
+    LOG (debug) << "actions: " << Action::lane_name (a->lane) << " action done, waited: "
+                << wait.count () << " ms, ran: " << a->run_time << " ms.";
+  }
+
+  void ActionManager::log_stats () {
+    std::lock_guard<std::mutex> lk (actions_m);
+
+    for (int l = 0; l < Action::LANES; l++) {
+      LaneStats & st = lane_stats[l];
+
+      unsigned int queued = count_if (actions.begin (), actions.end (),
+          [&] (refptr<Action> a) { return a->lane == l; });
+
+      LOG (info) << "actions: " << Action::lane_name ((Action::Lane) l) << ": "
+                 << queued << " queued, " << st.count << " done"
+                 << ", wait avg: " << (st.count ? st.wait_total / st.count : 0) << " ms"
+                 << ", max: " << st.wait_max << " ms"
+                 << ", run avg: " << (st.count ? st.run_total / st.count : 0) << " ms"
+                 << ", max: " << st.run_max << " ms.";
     }
   }
 
@@ -96,29 +268,57 @@ namespace Astroid {
     LOG (info) << "actions: undo";
     std::unique_lock<std::mutex> lk (actions_m);
 
-    if (!actions.empty ()) {
+    /* the actions are not done in the order they are queued, the last
+     * action of the user is the one with the highest sequence number,
+     * whether it is still queued or done. */
+    auto q = actions.end ();
+    for (auto it = actions.begin (); it != actions.end (); it++) {
+      if ((*it)->in_undo) {
+        /* just ignore the undo if the previous undo is not finished yet */
+        LOG (debug) << "actions: undo still in queue, ignoring.";
+        return;
+      }
+
+      if (!(*it)->skip_undo && (q == actions.end () || (*it)->seq > (*q)->seq)) q = it;
+    }
+
+    auto d = doneactions.end ();
+    for (auto it = doneactions.begin (); it != doneactions.end (); it++) {
+      if (d == doneactions.end () || (*it)->seq > (*d)->seq) d = it;
+    }
+
+    if (q != actions.end () && (d == doneactions.end () || (*q)->seq > (*d)->seq)) {
+      refptr<Action> a = *q;
+
+      if (a->running || a->remaining) {
+        /* what has been done is undone with the next undo */
+        LOG (info) << "actions: action is being done, cancelling..";
+        a->cancel ();
+        return;
+      }
+
       LOG (info) << "actions: action still in queue, removing..";
 
-      /* get last action queued and remove before it is done */
-      refptr<Action> a = actions.back ();
-      if (!a->in_undo && !a->skip_undo) actions.pop_back ();
+      /* remove before it is done */
+      actions.erase (q);
 
-      /* just ignore the undo if the previous undo is not finished yet */
-      return;
+      a->unjournal (journal);
+      emit_tags_applied ();
 
     } else {
-      if (doneactions.empty ()) {
+      if (d == doneactions.end ()) {
         LOG (debug) << "actions: no more actions to undo.";
         return;
       }
 
       LOG (info) << "actions: undoing already processed actions..";
 
-      /* get last action added and undo it */
-      refptr<Action> a = doneactions.back ();
-      doneactions.pop_back ();
+      refptr<Action> a = *d;
+      doneactions.erase (d);
 
       a->in_undo = true;
+      a->cancel_requested = false;
+      a->finished = false;
 
       lk.unlock ();
       doit (a); // queue for undo
@@ -128,19 +328,54 @@ namespace Astroid {
   void ActionManager::emitter () {
     /* runs on gui thread */
     if (emit) {
-      while (!toemit.empty ()) {
-        std::unique_lock<std::mutex> lk (toemit_m);
+      /* take all finished actions and emit them with one db, in the order
+       * they were done. */
+      std::queue<refptr<Action>> emitting;
 
-        refptr<Action> a = toemit.front ();
-        toemit.pop ();
-        lk.unlock ();
+      std::unique_lock<std::mutex> lk (toemit_m);
+      emitting.swap (toemit);
+      lk.unlock ();
+
+      if (emitting.empty ()) return;
+
+      LOG (debug) << "actions: emitting " << emitting.size () << " actions..";
+
+      Db db (Db::DATABASE_READ_ONLY);
+
+      batching = true;
 
-        Db db (Db::DATABASE_READ_ONLY);
-        a->emit (&db);
+      while (!emitting.empty ()) {
+        emitting.front ()->emit (&db);
+        emitting.pop ();
       }
+
+      batching = false;
+
+      emit_batch (&db);
     }
   }
 
+  void ActionManager::emit_batch (Db * db) {
+    /* a thread is signalled once, as updated if any action updated it */
+    std::unordered_set<std::string> seen;
+    std::vector<ustring> updated;
+    std::vector<ustring> changed;
+
+    for (auto & t : batch_updated) {
+      if (seen.insert (t.raw ()).second) updated.push_back (t);
+    }
+
+    for (auto & t : batch_changed) {
+      if (seen.insert (t.raw ()).second) changed.push_back (t);
+    }
+
+    batch_updated.clear ();
+    batch_changed.clear ();
+
+    if (!updated.empty ()) emit_threads_updated (db, updated);
+    if (!changed.empty ()) emit_threads_changed (db, changed);
+  }
+
   ActionManager::ActionManager () {
     LOG (info) << "global actions: set up.";
 
@@ -154,6 +389,17 @@ namespace Astroid {
         sigc::mem_fun (this,
           &ActionManager::emitter));
 
+    retry_delay = astroid->config ().get<int> ("actions.retry_delay");
+    chunk_size  = astroid->config ().get<unsigned int> ("actions.chunk_size");
+
+    /* write the tag changes that were not written by the last session */
+    journal = new TagJournal ();
+
+    auto unfinished = journal->take_unfinished ();
+    if (!unfinished.empty ()) {
+      doit (refptr<Action> (new ReplayAction (unfinished)), false);
+    }
+
     run = true;
     action_worker_t = std::thread (&ActionManager::action_worker, this);
   }
@@ -171,6 +417,10 @@ namespace Astroid {
     lk.unlock ();
     actions_cv.notify_one ();
     action_worker_t.join ();
+
+    journal->close ();
+    delete journal;
+    journal = NULL;
   }
 
 
@@ -182,11 +432,27 @@ namespace Astroid {
   }
 
   void ActionManager::emit_thread_updated (Db * db, ustring thread_id) {
+    if (batching) {
+      batch_updated.push_back (thread_id);
+      return;
+    }
+
     LOG (info) << "actions: emitted updated and changed signal for thread: " << thread_id;
     m_signal_thread_updated.emit (db, thread_id);
     m_signal_thread_changed.emit (db, thread_id);
   }
 
+  ActionManager::type_signal_threads_updated
+    ActionManager::signal_threads_updated ()
+  {
+    return m_signal_threads_updated;
+  }
+
+  void ActionManager::emit_threads_updated (Db * db, const std::vector<ustring> & thread_ids) {
+    LOG (info) << "actions: emitted updated signal for " << thread_ids.size () << " threads.";
+    m_signal_threads_updated.emit (db, thread_ids);
+  }
+
   ActionManager::type_signal_thread_changed
     ActionManager::signal_thread_changed ()
   {
@@ -194,10 +460,26 @@ namespace Astroid {
   }
 
   void ActionManager::emit_thread_changed (Db * db, ustring thread_id) {
+    if (batching) {
+      batch_changed.push_back (thread_id);
+      return;
+    }
+
     LOG (info) << "actions: emitted changed signal for thread: " << thread_id;
     m_signal_thread_changed.emit (db, thread_id);
   }
 
+  ActionManager::type_signal_threads_changed
+    ActionManager::signal_threads_changed ()
+  {
+    return m_signal_threads_changed;
+  }
+
+  void ActionManager::emit_threads_changed (Db * db, const std::vector<ustring> & thread_ids) {
+    LOG (info) << "actions: emitted changed signal for " << thread_ids.size () << " threads.";
+    m_signal_threads_changed.emit (db, thread_ids);
+  }
+
   /* message */
   ActionManager::type_signal_message_updated
     ActionManager::signal_message_updated ()
@@ -224,6 +506,24 @@ namespace Astroid {
       });
   }
 
+  void ActionManager::emit_message_updated (Db * db, ustring message_id, ustring thread_id) {
+    LOG (info) << "actions: emitted updated signal for message: " << message_id;
+    m_signal_message_updated.emit (db, message_id);
+
+    emit_thread_changed (db, thread_id);
+  }
+
+  /* tags applied */
+  ActionManager::type_signal_tags_applied
+    ActionManager::signal_tags_applied ()
+  {
+    return m_signal_tags_applied;
+  }
+
+  void ActionManager::emit_tags_applied () {
+    m_signal_tags_applied.emit ();
+  }
+
   /* refreshed */
   ActionManager::type_signal_refreshed
     ActionManager::signal_refreshed ()
@@ -1,6 +1,7 @@
 # pragma once
 
 # include <vector>
+# include <string>
 # include <queue>
 # include <deque>
 # include <thread>
@@ -10,6 +11,7 @@
 # include <sigc++/sigc++.h>
 
 # include "proto.hh"
+# include "action.hh"
 
 namespace Astroid {
   class ActionManager {
@@ -21,6 +23,9 @@ namespace Astroid {
       void undo ();
       void close ();
 
+      /* log the queue and the wait and run times of the actions by lane */
+      void log_stats ();
+
     private:
       bool run = false;
       std::thread action_worker_t;
@@ -29,18 +34,49 @@ namespace Astroid {
       std::mutex actions_m;
       std::condition_variable actions_cv;
 
+      TagJournal * journal = NULL;
+      int retry_delay; // seconds, when the db could not be opened
+      unsigned int chunk_size; // items, of the actions that are not interactive
+
       std::mutex toemit_m;
 
+      /* the order in which the actions were queued, for undo */
+      unsigned long next_seq = 1;
+
       std::deque<refptr<Action>> doneactions;
       std::deque<refptr<Action>> actions;
       std::queue<refptr<Action>> toemit;
 
+      /* actions are kept in the queue until they are done, actions_m must
+       * be held for these */
+      std::deque<refptr<Action>>::iterator next_action ();
+      void remove_action (refptr<Action>);
+
+      struct LaneStats {
+        unsigned long count = 0;
+        double        wait_total = 0; // ms, queued until started
+        double        wait_max   = 0; // ms
+        double        run_total  = 0; // ms, of all chunks
+        double        run_max    = 0; // ms
+      };
+
+      LaneStats lane_stats[Action::LANES];
+      void add_stats (refptr<Action>);
+
       Glib::Dispatcher emit_ready;
       void emitter ();
 
       /* used when closing: do not emit signals when closing */
       bool emit = true;
 
+      /* while the emitter emits the finished actions the thread signals
+       * are collected, and emitted once for all threads when they are
+       * done. */
+      bool batching = false;
+      std::vector<ustring> batch_updated;
+      std::vector<ustring> batch_changed;
+      void emit_batch (Db *);
+
     public:
       /* Overview of signals:
        *
@@ -77,6 +113,15 @@ namespace Astroid {
 
       void emit_thread_updated (Db *, ustring);
 
+      /* threads-updated: thread-updated for many threads at once, emitted
+       * from poll and for the finished actions instead of thread-updated and
+       * thread-changed for each thread. listeners should handle it as both
+       * for every thread. */
+      typedef sigc::signal <void, Db *, const std::vector<ustring> &> type_signal_threads_updated;
+      type_signal_threads_updated signal_threads_updated ();
+
+      void emit_threads_updated (Db *, const std::vector<ustring> &);
+
       /* thread-changed: more restrictive than thread-updated. emitted from
        * message-updated, as well as from thread-updated. so suitable for
        * thread-index where message-updated events are handled or not needed
@@ -86,12 +131,31 @@ namespace Astroid {
 
       void emit_thread_changed (Db *, ustring);
 
+      /* threads-changed: thread-changed for many threads at once, emitted
+       * for the finished actions. */
+      typedef sigc::signal <void, Db *, const std::vector<ustring> &> type_signal_threads_changed;
+      type_signal_threads_changed signal_threads_changed ();
+
+      void emit_threads_changed (Db *, const std::vector<ustring> &);
+
       /* message update signal */
       typedef sigc::signal <void, Db *, ustring> type_signal_message_updated;
       type_signal_message_updated signal_message_updated ();
 
       void emit_message_updated (Db *, ustring);
 
+      /* the thread of the message is known, so it does not have to be
+       * looked up */
+      void emit_message_updated (Db *, ustring, ustring);
+
+      /* tags-applied: the tag changes of an action have been applied to
+       * (or taken back from) the in-memory items, before they are written
+       * to the db. views showing the items should redraw them. */
+      typedef sigc::signal <void> type_signal_tags_applied;
+      type_signal_tags_applied signal_tags_applied ();
+
+      void emit_tags_applied ();
+
       /* refresh signal (after polling) */
       typedef sigc::signal <void> type_signal_refreshed;
       type_signal_refreshed signal_refreshed ();
@@ -102,8 +166,11 @@ namespace Astroid {
 
     protected:
       type_signal_thread_updated m_signal_thread_updated;
+      type_signal_threads_updated m_signal_threads_updated;
       type_signal_thread_changed m_signal_thread_changed;
+      type_signal_threads_changed m_signal_threads_changed;
       type_signal_message_updated m_signal_message_updated;
+      type_signal_tags_applied m_signal_tags_applied;
       type_signal_refreshed m_signal_refreshed;
 
   };
@@ -10,6 +10,14 @@ namespace Astroid {
     need_db    = false;
     need_db_rw = true;
     successful = false;
+
+    /* an external command may take a while */
+    lane = BULK;
+
+    if (thread_id != "") {
+      threads.insert (thread_id.raw ());
+      threads_known = true;
+    }
   }
 
   bool CmdAction::doit (Db *) {
@@ -61,61 +61,32 @@ namespace Astroid {
 
     sort (add.begin (), add.end ());
     sort (remove.begin (), remove.end ());
+  }
+
+  void DiffTagAction::resolve () {
+    changes.clear ();
 
-    for (auto &t : nmts) {
-      TaggableAction ta;
-      ta.taggable = t;
+    for (auto &t : taggables) {
+      Change c { t, TagJournal::make_entry (t) };
 
       /* find tags need to be removed */
       set_intersection (remove.begin (),
                         remove.end (),
                         t->tags.begin (),
                         t->tags.end (),
-                        std::back_inserter (ta.remove));
+                        std::back_inserter (c.entry.remove));
 
       /* find tags that should be added */
       set_difference (add.begin (),
                       add.end (),
                       t->tags.begin (),
                       t->tags.end (),
-                      std::back_inserter (ta.add));
-
-      if (!ta.add.empty () || !ta.remove.empty ()) {
-        taggable_actions.push_back (ta);
-      }
-    }
-  }
-
-  bool DiffTagAction::doit (Db * db) {
-    bool res = true;
-
-    for (auto &ta : taggable_actions) {
-      for (auto &t : ta.add) {
-        res &= ta.taggable->add_tag (db, t);
-      }
+                      std::back_inserter (c.entry.add));
 
-      for (auto &t : ta.remove) {
-        res &= ta.taggable->remove_tag (db, t);
+      if (!c.entry.add.empty () || !c.entry.remove.empty ()) {
+        changes.push_back (c);
       }
     }
-
-    return res;
-  }
-
-  bool DiffTagAction::undo (Db * db) {
-    bool res = true;
-
-    for (auto &ta : taggable_actions) {
-      for (auto &t : ta.add) {
-        res &= ta.taggable->remove_tag (db, t);
-      }
-
-      for (auto &t : ta.remove) {
-        res &= ta.taggable->add_tag (db, t);
-      }
-    }
-
-    return res;
   }
 }
 
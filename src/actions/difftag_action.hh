@@ -15,17 +15,9 @@ namespace Astroid {
 
       static DiffTagAction * create (std::vector<refptr<NotmuchItem>>, ustring);
 
-      virtual bool doit (Db *) override;
-      virtual bool undo (Db *) override;
-
-    private:
-      struct TaggableAction {
-        refptr<NotmuchItem> taggable;
-        std::vector<ustring>    add;
-        std::vector<ustring>    remove;
-      };
-
-      std::vector<TaggableAction> taggable_actions;
+    protected:
+      /* only the tags that differ from the tags of each item */
+      virtual void resolve () override;
   };
 }
 
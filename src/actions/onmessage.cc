@@ -17,6 +17,11 @@ namespace Astroid {
     msg_id  = _msg_id;
     tid     = _tid;
     block   = _b;
+
+    if (tid != "") {
+      threads.insert (tid.raw ());
+      threads_known = true;
+    }
   }
 
   bool OnMessageAction::doit (Db * db) {
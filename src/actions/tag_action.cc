@@ -40,32 +40,103 @@ namespace Astroid {
     return true;
   }
 
+  void TagAction::resolve () {
+    changes.clear ();
+
+    for (auto &t : taggables) {
+      Change c { t, TagJournal::make_entry (t) };
+
+      for (ustring a : add) {
+        a = Db::sanitize_tag (a);
+        if (Db::check_tag (a) && !t->has_tag (a)) c.entry.add.push_back (a);
+      }
+
+      for (ustring r : remove) {
+        r = Db::sanitize_tag (r);
+        if (Db::check_tag (r) && t->has_tag (r)) c.entry.remove.push_back (r);
+      }
+
+      if (!c.entry.add.empty () || !c.entry.remove.empty ()) {
+        changes.push_back (c);
+      }
+    }
+  }
+
+  void TagAction::journal (TagJournal * j) {
+    if (in_undo) {
+      /* only the changes that were done are reversed */
+      for (auto &c : changes) {
+        swap (c.entry.add, c.entry.remove);
+      }
+    } else {
+      resolve ();
+    }
+
+    for (auto &c : changes) {
+      j->write (c.entry);
+      journaled.push_back (c.entry.id);
+
+      c.taggable->apply_tags (c.entry.add, c.entry.remove);
+    }
+
+    j->sync ();
+
+    /* a change to a single item is interactive, the rest are done in
+     * chunks */
+    lane = (changes.size () > 1) ? BULK : INTERACTIVE;
+
+    threads.clear ();
+    for (auto &c : changes) threads.insert (c.taggable->thread_id.raw ());
+    threads_known = true;
+
+    progress  = 0;
+    total     = changes.size ();
+    remaining = false;
+  }
+
+  void TagAction::unjournal (TagJournal * j) {
+    Action::unjournal (j);
+
+    for (auto &c : changes) {
+      c.taggable->apply_tags (c.entry.remove, c.entry.add);
+    }
+  }
+
   bool TagAction::doit (Db * db) {
+    /* continues where the last chunk stopped */
     bool res = true;
-    for (auto &tagged : taggables) {
-      LOG (info) << "tag_action: " << tagged->str ();
+    unsigned int n = 0;
+
+    while (progress < changes.size ()) {
+      if (cancelled ()) {
+        LOG (warn) << "tag_action: cancelled after " << progress.load () << " of " << total.load () << " items.";
+        /* only what has been done can be undone */
+        changes.resize (progress);
+        total = progress.load ();
+        break;
+      }
 
+      if (chunk > 0 && n >= chunk) break;
 
-      for_each (add.begin(),
-                add.end(),
-                [&](ustring t) {
-                  res &= tagged->add_tag (db, t);
-                });
+      auto &c = changes[progress];
 
-      for_each (remove.begin(),
-                remove.end(),
-                [&](ustring t) {
-                  res &= tagged->remove_tag (db, t);
-                });
+      LOG (info) << "tag_action: " << c.taggable->str ();
 
+      res &= TagJournal::apply (db, c.entry);
+
+      progress++;
+      n++;
     }
+
+    remaining = (progress < changes.size ());
+
     return res;
   }
 
   bool TagAction::undo (Db * db) {
     LOG (info) << "tag_action: undo.";
 
-    swap (add, remove);
+    /* the changes were reversed when the undo was journaled */
     return doit (db);
   }
 
@@ -4,6 +4,7 @@
 
 # include "proto.hh"
 # include "action.hh"
+# include "tag_journal.hh"
 
 namespace Astroid {
   class TagAction : public Action {
@@ -31,6 +32,21 @@ namespace Astroid {
       virtual bool undoable () override;
       virtual void emit (Db *) override;
 
+      virtual void journal (TagJournal *) override;
+      virtual void unjournal (TagJournal *) override;
+
+    protected:
+      /* the tags that are added to and removed from each item, resolved
+       * against the in-memory tags when the action is queued. undo
+       * reverses them. */
+      struct Change {
+        refptr<NotmuchItem> taggable;
+        TagJournal::Entry   entry;
+      };
+
+      std::vector<Change> changes;
+
+      virtual void resolve ();
   };
 
 }
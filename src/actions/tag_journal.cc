@@ -0,0 +1,353 @@
+# include <iostream>
+# include <fstream>
+# include <sstream>
+# include <vector>
+# include <string>
+# include <map>
+# include <algorithm>
+# include <unistd.h>
+
+# include <notmuch.h>
+
+# include "astroid.hh"
+# include "config.hh"
+# include "db.hh"
+
+# include "action_manager.hh"
+# include "tag_journal.hh"
+
+using namespace std;
+
+namespace Astroid {
+  TagJournal::TagJournal () {
+    enable       = astroid->config ().get<bool> ("actions.journal");
+    journal_file = astroid->standard_paths ().data_dir / bfs::path ("tag-journal");
+
+    if (!enable) {
+      LOG (info) << "journal: disabled, tag changes that are not written when astroid exits are lost.";
+      return;
+    }
+
+    load ();
+  }
+
+  TagJournal::TagJournal (bfs::path file) {
+    enable       = true;
+    journal_file = file;
+
+    load ();
+  }
+
+  void TagJournal::load () {
+    /* entries that are not done, by id */
+    map<unsigned long, Entry> entries;
+
+    if (bfs::exists (journal_file)) {
+      ifstream f (journal_file.c_str ());
+      string line;
+
+      while (getline (f, line)) {
+        if (line.empty ()) continue;
+
+        if (line[0] == '-') {
+          try {
+            entries.erase (stoul (line.substr (1)));
+          } catch (const std::exception &) {
+            LOG (warn) << "journal: skipping bad line: " << line;
+          }
+
+          continue;
+        }
+
+        Entry e;
+        if (parse (line, e)) {
+          entries[e.id] = e;
+          next_id = max (next_id, e.id + 1);
+        } else {
+          /* e.g. the last line when astroid crashed while writing it */
+          LOG (warn) << "journal: skipping bad line: " << line;
+        }
+      }
+    }
+
+    for (auto & e : entries) {
+      unfinished.push_back (e.second);
+      pending.insert (e.first);
+    }
+
+    if (!unfinished.empty ()) {
+      LOG (warn) << "journal: " << unfinished.size () << " tag changes were not written by the last session.";
+    }
+
+    /* rewrite with only the unfinished entries */
+    boost::system::error_code ec;
+    bfs::create_directories (journal_file.parent_path (), ec);
+
+    bfs::path tmp = journal_file;
+    tmp += ".tmp";
+
+    FILE * t = fopen (tmp.c_str (), "w");
+    if (t != NULL) {
+      for (auto & e : unfinished) fputs (format (e).c_str (), t);
+
+      fflush (t);
+      fsync (fileno (t));
+      fclose (t);
+
+      bfs::rename (tmp, journal_file, ec);
+    }
+
+    journal = fopen (journal_file.c_str (), "a");
+
+    if (journal == NULL) {
+      LOG (error) << "journal: could not open: " << journal_file.c_str () << ", tag changes that are not written when astroid exits are lost.";
+    }
+  }
+
+  void TagJournal::close () {
+    std::lock_guard<std::mutex> lk (journal_m);
+
+    if (!pending.empty ()) {
+      LOG (warn) << "journal: " << pending.size () << " tag changes were not written, they are written on the next start.";
+    }
+
+    if (journal != NULL) {
+      fclose (journal);
+      journal = NULL;
+    }
+  }
+
+  TagJournal::Entry TagJournal::make_entry (refptr<NotmuchItem> item) {
+    Entry e;
+
+    refptr<NotmuchThread> t = refptr<NotmuchThread>::cast_dynamic (item);
+
+    if (t) {
+      e.thread = true;
+      e.item   = t->thread_id;
+    } else {
+      e.thread = false;
+      e.item   = refptr<NotmuchMessage>::cast_dynamic (item)->mid;
+    }
+
+    return e;
+  }
+
+  void TagJournal::write (Entry & e) {
+    std::lock_guard<std::mutex> lk (journal_m);
+
+    e.id = next_id++;
+    pending.insert (e.id);
+
+    put (format (e));
+  }
+
+  void TagJournal::sync () {
+    std::lock_guard<std::mutex> lk (journal_m);
+
+    if (journal != NULL) {
+      fflush (journal);
+      fsync (fileno (journal));
+    }
+  }
+
+  void TagJournal::done (const vector<unsigned long> & ids) {
+    std::lock_guard<std::mutex> lk (journal_m);
+
+    for (auto id : ids) {
+      if (pending.erase (id)) put ("-\t" + to_string (id) + "\n");
+    }
+
+    if (journal == NULL) return;
+
+    if (pending.empty ()) {
+      /* nothing left to replay */
+      fclose (journal);
+      journal = fopen (journal_file.c_str (), "w");
+
+      if (journal == NULL) {
+        LOG (error) << "journal: could not truncate: " << journal_file.c_str ();
+      }
+
+    } else {
+      fflush (journal);
+      fsync (fileno (journal));
+    }
+  }
+
+  vector<TagJournal::Entry> TagJournal::take_unfinished () {
+    std::lock_guard<std::mutex> lk (journal_m);
+
+    vector<Entry> es;
+    es.swap (unfinished);
+    return es;
+  }
+
+  void TagJournal::put (const string & line) {
+    /* journal_m must be held */
+    if (journal != NULL) fputs (line.c_str (), journal);
+  }
+
+  string TagJournal::format (const Entry & e) {
+    string line = "+\t" + to_string (e.id) + "\t" + (e.thread ? "t" : "m") + "\t" + e.item.raw ();
+
+    for (auto & t : e.add)    line += "\t+" + t.raw ();
+    for (auto & t : e.remove) line += "\t-" + t.raw ();
+
+    return line + "\n";
+  }
+
+  bool TagJournal::parse (const string & line, Entry & e) {
+    vector<string> fields;
+    stringstream ss (line);
+    string f;
+
+    while (getline (ss, f, '\t')) fields.push_back (f);
+
+    if (fields.size () < 4 || fields[0] != "+" || fields[3].empty ()) return false;
+    if (fields[2] != "t" && fields[2] != "m") return false;
+
+    try {
+      e.id = stoul (fields[1]);
+    } catch (const std::exception &) {
+      return false;
+    }
+
+    e.thread = (fields[2] == "t");
+    e.item   = fields[3];
+
+    for (auto it = fields.begin () + 4; it != fields.end (); it++) {
+      if (it->size () < 2) return false;
+
+      if ((*it)[0] == '+') {
+        e.add.push_back (it->substr (1));
+      } else if ((*it)[0] == '-') {
+        e.remove.push_back (it->substr (1));
+      } else {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool TagJournal::apply (Db * db, const Entry & e) {
+    bool res = true;
+
+    auto tag_message = [&] (notmuch_message_t * message) {
+      notmuch_message_freeze (message);
+
+      for (auto & t : e.add) {
+        res &= (notmuch_message_add_tag (message, t.c_str ()) == NOTMUCH_STATUS_SUCCESS);
+      }
+
+      for (auto & t : e.remove) {
+        res &= (notmuch_message_remove_tag (message, t.c_str ()) == NOTMUCH_STATUS_SUCCESS);
+      }
+
+      notmuch_message_thaw (message);
+
+      if (db->maildir_synchronize_flags) {
+        res &= (notmuch_message_tags_to_maildir_flags (message) == NOTMUCH_STATUS_SUCCESS);
+      }
+    };
+
+    try {
+      if (e.thread) {
+        db->on_thread (e.item, [&] (notmuch_thread_t * nm_thread) {
+            if (nm_thread == NULL) {
+              res = false;
+              return;
+            }
+
+            notmuch_messages_t * qmessages;
+
+            for (qmessages = notmuch_thread_get_messages (nm_thread);
+                 notmuch_messages_valid (qmessages);
+                 notmuch_messages_move_to_next (qmessages)) {
+
+              notmuch_message_t * message = notmuch_messages_get (qmessages);
+              tag_message (message);
+              notmuch_message_destroy (message);
+            }
+          });
+
+      } else {
+        db->on_message (e.item, [&] (notmuch_message_t * message) {
+            if (message == NULL) {
+              res = false;
+              return;
+            }
+
+            tag_message (message);
+          });
+      }
+
+    } catch (invalid_argument &ex) {
+      /* the thread has been removed or merged since the entry was made */
+      res = false;
+    }
+
+    if (!res) {
+      LOG (error) << "journal: could not write tags of: " << e.item;
+    }
+
+    return res;
+  }
+
+  /* ReplayAction */
+  ReplayAction::ReplayAction (vector<TagJournal::Entry> _entries)
+    : entries (_entries)
+  {
+    for (auto & e : entries) journaled.push_back (e.id);
+
+    /* the thread of a message entry is not known, and the actions queued
+     * after this one may only pass it if all entries are threads */
+    lane = BACKGROUND;
+
+    threads_known = true;
+    for (auto & e : entries) {
+      if (e.thread) {
+        threads.insert (e.item.raw ());
+      } else {
+        threads_known = false;
+      }
+    }
+
+    total = entries.size ();
+  }
+
+  bool ReplayAction::doit (Db * db) {
+    if (progress == 0) {
+      LOG (info) << "journal: writing " << entries.size () << " tag changes of the last session..";
+    }
+
+    bool res = true;
+    unsigned int n = 0;
+
+    while (progress < entries.size () && (chunk == 0 || n < chunk)) {
+      res &= TagJournal::apply (db, entries[progress]);
+      progress++;
+      n++;
+    }
+
+    remaining = (progress < entries.size ());
+
+    return res;
+  }
+
+  bool ReplayAction::undo (Db *) {
+    return false;
+  }
+
+  void ReplayAction::emit (Db * db) {
+    for (auto & e : entries) {
+      if (e.thread) {
+        astroid->actions->emit_thread_updated (db, e.item);
+      } else {
+        astroid->actions->emit_message_updated (db, e.item);
+      }
+    }
+  }
+}
+
@@ -0,0 +1,89 @@
+# pragma once
+
+# include <vector>
+# include <string>
+# include <set>
+# include <mutex>
+# include <cstdio>
+
+# include <boost/filesystem.hpp>
+
+# include "proto.hh"
+# include "action.hh"
+
+namespace bfs = boost::filesystem;
+
+namespace Astroid {
+  /* tag changes are appended to the journal when the action is queued, and
+   * marked done when the action worker has written them to the db. the
+   * entries that are not done when astroid exits (or crashes, or gives up
+   * waiting for the db) are replayed on the next start.
+   *
+   * every entry is the change to the tags of one thread or message. the
+   * entries are kept in the data dir as lines of tab separated fields:
+   *
+   *  + <id> <t|m> <thread or message id> <+tag> <-tag> ..
+   *  - <id>
+   *
+   * the journal is rewritten with only the unfinished entries on start, and
+   * truncated whenever all entries are done. */
+  class TagJournal {
+    public:
+      TagJournal ();
+      TagJournal (bfs::path file); // enabled, whatever the config
+      void close ();
+
+      struct Entry {
+        unsigned long         id = 0;
+        bool                  thread = true;
+        ustring               item; // thread id or message id
+        std::vector<ustring>  add;
+        std::vector<ustring>  remove;
+      };
+
+      /* an entry without changes for the thread or message */
+      static Entry make_entry (refptr<NotmuchItem>);
+
+      /* assign an id and append the entry, call sync () after the last */
+      void write (Entry &);
+      void sync ();
+
+      void done (const std::vector<unsigned long> & ids);
+
+      /* the unfinished entries of the last session, only once */
+      std::vector<Entry> take_unfinished ();
+
+      /* write the changes to the db, whatever the tags of the in-memory
+       * items */
+      static bool apply (Db *, const Entry &);
+
+    private:
+      bool enable;
+      bfs::path journal_file;
+      FILE * journal = NULL;
+
+      std::mutex journal_m;
+      unsigned long next_id = 1;
+      std::set<unsigned long> pending;
+      std::vector<Entry> unfinished;
+
+      void load ();
+      void put (const std::string & line);
+
+      static std::string format (const Entry &);
+      static bool parse (const std::string & line, Entry &);
+  };
+
+  /* writes the unfinished entries of the last session */
+  class ReplayAction : public Action {
+    public:
+      ReplayAction (std::vector<TagJournal::Entry>);
+
+      std::vector<TagJournal::Entry> entries;
+
+      virtual bool doit (Db *) override;
+      virtual bool undo (Db *) override;
+      virtual void emit (Db *) override;
+  };
+}
+
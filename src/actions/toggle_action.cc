@@ -24,37 +24,20 @@ namespace Astroid {
     toggle_tag = _toggle_tag;
   }
 
-  bool ToggleAction::doit (Db * db) {
-    bool res = true;
+  void ToggleAction::resolve () {
+    changes.clear ();
 
-    for (auto &tagged : taggables) {
-      LOG (debug) << "toggle_action: " << tagged->str ();
+    for (auto &t : taggables) {
+      Change c { t, TagJournal::make_entry (t) };
 
-      if (find (tagged->tags.begin(), tagged->tags.end(), toggle_tag) != tagged->tags.end ()) {
-        remove.push_back (toggle_tag);
+      if (t->has_tag (toggle_tag)) {
+        c.entry.remove.push_back (toggle_tag);
       } else {
-        add.push_back (toggle_tag);
+        c.entry.add.push_back (toggle_tag);
       }
 
-
-      for_each (add.begin(),
-                add.end(),
-                [&](ustring t) {
-                  res &= tagged->add_tag (db, t);
-                });
-
-      for_each (remove.begin(),
-                remove.end(),
-                [&](ustring t) {
-                  res &= tagged->remove_tag (db, t);
-                });
-
-
-      remove.clear ();
-      add.clear ();
+      changes.push_back (c);
     }
-
-    return res;
   }
 
   SpamAction::SpamAction (refptr<NotmuchItem> nmt)
@@ -12,9 +12,10 @@ namespace Astroid {
       ToggleAction (std::vector<refptr<NotmuchItem>>, ustring);
       ustring toggle_tag;
 
-      /* for toggleaction undo == doit, which works with
-       * how it is defined in tagaction. */
-      virtual bool doit (Db *) override;
+    protected:
+      /* the tag is removed from the items that have it, and added to the
+       * others */
+      virtual void resolve () override;
   };
 
   class SpamAction : public ToggleAction {
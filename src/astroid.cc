@@ -34,6 +34,8 @@
 # include "actions/action.hh"
 # include "utils/date_utils.hh"
 # include "utils/utils.hh"
+# include "utils/avatar_cache.hh"
+# include "utils/message_prefetch.hh"
 
 # ifndef DISABLE_PLUGINS
   # include "plugin/manager.hh"
@@ -317,6 +319,12 @@ namespace Astroid {
       /* set up poller */
       poll = new Poll (!no_auto_poll);
 
+      /* set up avatar cache */
+      avatars = new AvatarCache ();
+
+      /* set up message prefetch */
+      prefetch = new MessagePrefetch ();
+
       Gtk::Application::run (argc, argv);
 
       on_quit ();
@@ -378,6 +386,12 @@ namespace Astroid {
 
     /* set up poller */
     poll = new Poll (false);
+
+    /* set up avatar cache */
+    avatars = new AvatarCache ();
+
+    /* set up message prefetch */
+    prefetch = new MessagePrefetch ();
   } // }}}
 
   bool Astroid::in_test () {
@@ -391,6 +405,8 @@ namespace Astroid {
     if (poll) poll->close ();
 
     if (actions) actions->close ();
+    if (avatars) avatars->close ();
+    if (prefetch) prefetch->close ();
     SavedSearches::destruct ();
 
 # ifndef DISABLE_PLUGINS
@@ -415,6 +431,16 @@ namespace Astroid {
       actions->close ();
       delete actions;
     }
+
+    if (avatars) {
+      avatars->close ();
+      delete avatars;
+    }
+
+    if (prefetch) {
+      prefetch->close ();
+      delete prefetch;
+    }
   }
 
   int Astroid::on_command_line (const refptr<Gio::ApplicationCommandLine> & cmd) {
@@ -56,6 +56,12 @@ namespace Astroid {
       /* poll */
       Poll * poll;
 
+      /* avatars */
+      AvatarCache * avatars = NULL;
+
+      /* prefetched messages */
+      MessagePrefetch * prefetch = NULL;
+
       MainWindow * open_new_window (bool open_defaults = true);
 
       int hint_level ();
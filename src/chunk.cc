@@ -551,6 +551,30 @@ namespace Astroid {
     return refptr<Chunk>();
   }
 
+  refptr<Chunk> Chunk::get_by_content_id (ustring cid, bool check_siblings) {
+    if (check_siblings) {
+      for (auto c : siblings) {
+        if (c->content_id == cid) {
+          return c;
+        } else {
+          auto kc = c->get_by_content_id (cid, false);
+          if (kc) return kc;
+        }
+      }
+    }
+
+    for (auto c : kids) {
+      if (c->content_id == cid) {
+        return c;
+      } else {
+        auto kc = c->get_by_content_id (cid, true);
+        if (kc) return kc;
+      }
+    }
+
+    return refptr<Chunk>();
+  }
+
   void Chunk::open () {
     using bfs::path;
     LOG (info) << "chunk: " << get_filename () << ", opening..";
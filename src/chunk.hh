@@ -34,6 +34,7 @@ namespace Astroid {
       std::vector<refptr<Chunk>> kids;
       std::vector<refptr<Chunk>> siblings;
       refptr<Chunk> get_by_id (int, bool check_siblings = true);
+      refptr<Chunk> get_by_content_id (ustring, bool check_siblings = true);
 
       bool any_kids_viewable ();
       bool any_kids_viewable_and_preferred ();
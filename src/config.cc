@@ -166,6 +166,14 @@ namespace Astroid {
     default_config.put ("thread_index.page_jump_rows", 6);
     default_config.put ("thread_index.sort_order", "newest");
 
+    /* parse the thread under the cursor and the next unread threads in
+     * the background after the cursor has rested for delay seconds, cache
+     * size in MB. */
+    default_config.put ("thread_index.prefetch.enable", true);
+    default_config.put ("thread_index.prefetch.delay", .3);
+    default_config.put ("thread_index.prefetch.unread", 3);
+    default_config.put ("thread_index.prefetch.cache_size", 32);
+
     default_config.put ("general.time.clock_format", "local"); // or 24h, 12h
     default_config.put ("general.time.same_year", "%b %-e");
     default_config.put ("general.time.diff_year", "%x");
@@ -224,6 +232,41 @@ namespace Astroid {
     /* polling */
     default_config.put ("poll.interval", Poll::DEFAULT_POLL_INTERVAL); // seconds
     default_config.put ("poll.always_full_refresh", false); // always do full refresh after poll, slow.
+    default_config.put ("poll.output_lines", 1000); // lines of poll script output kept, the last are logged if it fails.
+
+    /* instead of the poll script, several sources may be configured as
+     * poll.sources.<name>.command (run in the config dir or from PATH),
+     * with optional interval and timeout (seconds). at most max_running
+     * are polled at the time, a failing source is retried with an
+     * increasing delay of at most backoff_max seconds. a timeout of 0 is
+     * no timeout. */
+    default_config.put ("poll.timeout", 0);
+    default_config.put ("poll.max_running", 2);
+    default_config.put ("poll.backoff_max", 30 * 60);
+
+    /* watch the notmuch database and refresh when it is changed by others
+     * (e.g. notmuch new), changes are collected for watch_delay seconds.
+     * optionally watch the new/ folders of the maildirs and poll when mail
+     * arrives. */
+    default_config.put ("poll.watch", true);
+    default_config.put ("poll.watch_delay", .5);
+    default_config.put ("poll.watch_maildir", false);
+
+    /* index mail that is added to or removed from the maildirs while astroid
+     * is running, instead of waiting for the next poll */
+    default_config.put ("poll.indexer", false);
+
+    /* tag changes are kept in a journal until they are written to the
+     * notmuch db, and written on the next start if astroid exits before.
+     * the db is tried again after retry_delay seconds when it could not be
+     * opened. */
+    default_config.put ("actions.journal", true);
+    default_config.put ("actions.retry_delay", 10);
+
+    /* tag changes to more than one thread, and commands, are done chunk_size
+     * items at the time, with the changes to single threads done in
+     * between */
+    default_config.put ("actions.chunk_size", 50);
 
     /* attachments
      *
@@ -259,6 +302,15 @@ namespace Astroid {
     /* gravatar */
     default_config.put ("thread_view.gravatar.enable", true);
 
+    /* avatars
+     *
+     *   resolved avatars are kept in a cache on disk, addresses without an
+     *   avatar are retried after a week. a directory of local avatars
+     *   (named by address, e.g.: foo@example.com.png) may be specified, these
+     *   take precedence over gravatar and plugins. */
+    default_config.put ("thread_view.avatar.cache", true);
+    default_config.put ("thread_view.avatar.directory", "");
+
     /* mark unread */
     default_config.put ("thread_view.mark_unread_delay", .5);
 
@@ -289,6 +341,8 @@ namespace Astroid {
       LOG (info) << "cf: test config, loading defaults.";
       config = setup_default_config (true);
       config.put ("poll.interval", 0);
+      config.put ("poll.watch", false);
+      config.put ("actions.journal", false);
       config.put ("accounts.charlie.gpgkey", "gaute@astroidmail.bar");
       config.put ("mail.send_delay", 0);
       std::string test_nmcfg_path = path(current_path() / path ("tests/mail/test_config")).string();
@@ -1,5 +1,6 @@
 # include <iostream>
 # include <vector>
+# include <sstream>
 # include <algorithm>
 # include <exception>
 # include <boost/filesystem.hpp>
@@ -25,9 +26,19 @@ using namespace std;
 using namespace boost::filesystem;
 
 namespace Astroid {
-  std::atomic<int>          Db::read_only_dbs_open;
-  std::mutex                Db::db_open;
-  std::condition_variable   Db::dbs_open;
+  std::mutex                Db::lock_m;
+  std::condition_variable   Db::lock_cv;
+  std::map<unsigned long, Db::LockHolder> Db::lock_holders;
+  unsigned long             Db::next_lock_id = 1;
+  int                       Db::read_only_dbs_open = 0;
+  bool                      Db::read_write_db_open = false;
+  unsigned long             Db::rw_tickets = 0;
+  unsigned long             Db::rw_serving = 0;
+  Db::LockStats             Db::ro_stats;
+  Db::LockStats             Db::rw_stats;
+  std::thread::id           Db::gui_thread;
+  std::mutex                Db::written_m;
+  std::deque<std::pair<unsigned long, unsigned long>> Db::written;
 
   /* static settings */
   bool Db::maildir_synchronize_flags = false;
@@ -41,6 +52,8 @@ namespace Astroid {
   void Db::init () {
     const ptree& config = astroid->notmuch_config ();
 
+    gui_thread = std::this_thread::get_id ();
+
     const char * home = getenv ("HOME");
     if (home == NULL) {
       LOG (error) << "db: error: HOME variable not set.";
@@ -108,7 +121,7 @@ namespace Astroid {
 
     /* lock will wait for all read-onlys to close, lk will not be released before
      * db is closed */
-    rw_lock = Db::acquire_rw_lock ();
+    lock_id = Db::acquire_rw_lock ();
 
     notmuch_status_t s;
 
@@ -141,17 +154,19 @@ namespace Astroid {
     if (s != NOTMUCH_STATUS_SUCCESS) {
       LOG (error) << "db: error: failed opening database for writing, have you configured the notmuch database path correctly?";
 
-      release_rw_lock (rw_lock);
+      release_rw_lock (lock_id);
       throw database_error ("failed to open database for writing");
 
       return false;
     }
 
+    opened_revision = get_revision ();
+
     return true;
   }
 
   bool Db::open_db_read_only (bool block) {
-    Db::acquire_ro_lock ();
+    lock_id = Db::acquire_ro_lock ();
 
     notmuch_status_t s;
 
@@ -179,7 +194,7 @@ namespace Astroid {
     if (s != NOTMUCH_STATUS_SUCCESS) {
       LOG (error) << "db: error: failed opening database for reading, have you configured the notmuch database path correctly?";
 
-      release_ro_lock ();
+      release_ro_lock (lock_id);
       throw database_error ("failed to open database (in read-only mode)");
 
       return false;
@@ -188,39 +203,194 @@ namespace Astroid {
     return true;
   }
 
-  std::unique_lock<std::mutex> Db::acquire_rw_lock () {
-    /* lock will wait for all read-onlys to close, lk will not be released before
-     * db is closed */
-    LOG (debug) << "db: rw-s: waiting for rw lock.. (r-o open: " << read_only_dbs_open << ")";
-    std::unique_lock<std::mutex> rwl (db_open);
-    dbs_open.wait (rwl, [] { return (read_only_dbs_open == 0); });
-    LOG (debug) << "db: rw-s lock acquired.";
+  unsigned long Db::acquire_rw_lock () {
+    auto requested = chrono::steady_clock::now ();
+
+    std::unique_lock<std::mutex> lk (lock_m);
+
+    if (holds_lock (this_thread::get_id (), false) || holds_lock (this_thread::get_id (), true)) {
+      LOG (error) << "db: deadlock: read-write lock requested by a thread that holds a lock, the locks are held by:";
+      log_holders ();
+      throw database_error ("db: read-write lock requested by a thread that holds a lock");
+    }
+
+    /* lock will wait for all read-onlys to close, and for the read-writes
+     * requested earlier */
+    unsigned long ticket = rw_tickets++;
+
+    LOG (debug) << "db: rw: waiting for lock.. (r-o open: " << read_only_dbs_open << ", r-w waiting: " << (ticket - rw_serving) << ")";
+
+    wait_lock (lk, "rw", [&] {
+        return (!read_write_db_open && read_only_dbs_open == 0 && rw_serving == ticket);
+      });
+
+    rw_serving++;
+    read_write_db_open = true;
 
-    return rwl;
+    return add_holder (true, requested);
   }
 
-  void Db::release_rw_lock (std::unique_lock<std::mutex> &rwl) {
-    LOG (debug) << "db: rw-s: releasing lock.";
-    rwl.unlock ();
-    dbs_open.notify_all ();
+  void Db::release_rw_lock (unsigned long id) {
+    LOG (debug) << "db: rw: releasing lock.";
+    release_lock (id);
   }
 
-  void Db::acquire_ro_lock () {
+  unsigned long Db::acquire_ro_lock () {
     LOG (info) << "db: open db read-only, waiting for lock..";
 
-    /* will block if there is an read-write db open */
-    std::lock_guard<std::mutex> lk (db_open);
+    auto requested = chrono::steady_clock::now ();
+
+    std::unique_lock<std::mutex> lk (lock_m);
+
+    if (holds_lock (this_thread::get_id (), true)) {
+      LOG (error) << "db: deadlock: read-only lock requested by a thread that holds the read-write lock, the locks are held by:";
+      log_holders ();
+      throw database_error ("db: read-only lock requested by a thread that holds the read-write lock");
+    }
+
+    /* will block if there is an read-write db open, or waiting - unless
+     * this thread already holds a read-only db, which the read-write db is
+     * waiting for, or this is the gui thread: its read-only dbs are short,
+     * and it should not wait for a long read-only db of another thread
+     * (e.g. a query loader) that the read-write db is waiting for. */
+    bool skip_waiting = holds_lock (this_thread::get_id (), false) ||
+                        (this_thread::get_id () == gui_thread);
+
+    wait_lock (lk, "ro", [&] {
+        return (!read_write_db_open && (skip_waiting || rw_serving == rw_tickets));
+      });
+
     read_only_dbs_open++;
+
     LOG (debug) << "db: read-only got lock.";
+
+    return add_holder (false, requested);
   }
 
-  void Db::release_ro_lock () {
-    LOG (debug) << "db: ro: waiting for lock to close..";
-    std::unique_lock<std::mutex> lk (db_open);
+  void Db::release_ro_lock (unsigned long id) {
     LOG (debug) << "db: ro: closing..";
-    read_only_dbs_open--;
+    release_lock (id);
+  }
+
+  void Db::wait_lock (std::unique_lock<std::mutex> & lk, const char * what, std::function<bool()> pred) {
+    chrono::seconds delay (+lock_report_delay);
+    int waited = 0;
+
+    while (!lock_cv.wait_for (lk, delay, pred)) {
+      waited += delay.count ();
+
+      LOG (warn) << "db: " << what << ": waited " << waited << " s for the lock, it is held by:";
+      log_holders ();
+    }
+  }
+
+  unsigned long Db::add_holder (bool rw, chrono::steady_clock::time_point requested) {
+    auto now = chrono::steady_clock::now ();
+
+    unsigned long id = next_lock_id++;
+    lock_holders[id] = LockHolder { rw, this_thread::get_id (), now };
+
+    double wait = chrono::duration<double, milli> (now - requested).count ();
+
+    LockStats & st = rw ? rw_stats : ro_stats;
+    st.count++;
+    st.wait_total += wait;
+    st.wait_max    = max (st.wait_max, wait);
+
+    if (wait > 100.) {
+      LOG (info) << "db: " << (rw ? "rw" : "ro") << ": waited " << wait << " ms for the lock.";
+    }
+
+    return id;
+  }
+
+  void Db::release_lock (unsigned long id) {
+    std::unique_lock<std::mutex> lk (lock_m);
+
+    auto h = lock_holders.find (id);
+
+    if (h == lock_holders.end ()) {
+      LOG (error) << "db: releasing a lock that is not held: " << id;
+      return;
+    }
+
+    double held = chrono::duration<double, milli> (chrono::steady_clock::now () - h->second.since).count ();
+
+    LockStats & st = h->second.rw ? rw_stats : ro_stats;
+    st.held_total += held;
+    st.held_max    = max (st.held_max, held);
+
+    if (h->second.rw) {
+      read_write_db_open = false;
+    } else {
+      read_only_dbs_open--;
+    }
+
+    lock_holders.erase (h);
+
     lk.unlock ();
-    dbs_open.notify_all ();
+    lock_cv.notify_all ();
+  }
+
+  bool Db::holds_lock (std::thread::id thread, bool rw) {
+    return any_of (lock_holders.begin (), lock_holders.end (),
+        [&] (const pair<const unsigned long, LockHolder> & h) {
+          return (h.second.thread == thread && h.second.rw == rw);
+        });
+  }
+
+  void Db::log_holders () {
+    auto now = chrono::steady_clock::now ();
+
+    if (lock_holders.empty ()) {
+      LOG (warn) << "db: (no locks held)";
+    }
+
+    for (auto & h : lock_holders) {
+      std::ostringstream thread;
+      if (h.second.thread == gui_thread) {
+        thread << "gui";
+      } else {
+        thread << h.second.thread;
+      }
+
+      LOG (warn) << "db: lock " << h.first << ": "
+                 << (h.second.rw ? "read-write" : "read-only")
+                 << ", thread: " << thread.str ()
+                 << ", held for: " << chrono::duration<double, milli> (now - h.second.since).count () << " ms.";
+    }
+
+    if (rw_tickets > rw_serving) {
+      LOG (warn) << "db: " << (rw_tickets - rw_serving) << " read-write locks waiting.";
+    }
+  }
+
+  void Db::log_locks () {
+    std::lock_guard<std::mutex> lk (lock_m);
+
+    for (auto & st : { make_pair ("ro", ro_stats), make_pair ("rw", rw_stats) }) {
+      LOG (info) << "db: " << st.first << ": " << st.second.count << " locks"
+                 << ", wait avg: " << (st.second.count ? st.second.wait_total / st.second.count : 0) << " ms"
+                 << ", max: " << st.second.wait_max << " ms"
+                 << ", held avg: " << (st.second.count ? st.second.held_total / st.second.count : 0) << " ms"
+                 << ", max: " << st.second.held_max << " ms.";
+    }
+
+    log_holders ();
+  }
+
+  unsigned long Db::skip_written (unsigned long from) {
+    std::lock_guard<std::mutex> lk (written_m);
+
+    /* the ranges are in the order the dbs were closed, and do not overlap
+     * since only one read-write db is open at the time */
+    for (auto & w : written) {
+      if (w.first <= from && w.second > from) from = w.second;
+    }
+
+    while (!written.empty () && written.front ().second <= from) written.pop_front ();
+
+    return from;
   }
 
   void Db::close () {
@@ -229,15 +399,25 @@ namespace Astroid {
 
       if (nm_db != NULL) {
         LOG (info) << "db: closing db.";
+
+        if (mode == DATABASE_READ_WRITE) {
+          unsigned long rev = get_revision ();
+
+          if (rev > opened_revision) {
+            std::lock_guard<std::mutex> lk (written_m);
+            written.push_back (std::make_pair (opened_revision, rev));
+            if (written.size () > WRITTEN_MAX) written.pop_front ();
+          }
+        }
+
         notmuch_database_close (nm_db);
         nm_db = NULL;
       }
 
       if (mode == DATABASE_READ_WRITE) {
-        LOG (debug) << "db: rw: releasing lock.";
-        release_rw_lock (rw_lock);
+        release_rw_lock (lock_id);
       } else {
-        release_ro_lock ();
+        release_ro_lock (lock_id);
       }
     }
   }
@@ -286,6 +466,38 @@ namespace Astroid {
     return (s != NOTMUCH_STATUS_DUPLICATE_MESSAGE_ID);
   }
 
+  bool Db::index_file (ustring fname, const vector<ustring> & new_tags) {
+    notmuch_message_t * msg;
+
+    notmuch_status_t s = notmuch_database_index_file (nm_db,
+        fname.c_str (),
+        notmuch_database_get_default_indexopts (nm_db),
+        &msg);
+
+    if ((s != NOTMUCH_STATUS_SUCCESS) && (s != NOTMUCH_STATUS_DUPLICATE_MESSAGE_ID)) {
+      /* e.g. moved again before it was indexed, or not an email */
+      LOG (warn) << "db: could not index file: " << fname << " (" << s << ")";
+      return false;
+    }
+
+    notmuch_message_freeze (msg);
+
+    if (s == NOTMUCH_STATUS_SUCCESS) {
+      for (const ustring &t : new_tags) {
+        notmuch_message_add_tag (msg, t.c_str());
+      }
+    }
+
+    if (maildir_synchronize_flags) {
+      notmuch_message_maildir_flags_to_tags (msg);
+    }
+
+    notmuch_message_thaw (msg);
+    notmuch_message_destroy (msg);
+
+    return true;
+  }
+
   ustring Db::add_message_with_tags (ustring fname, vector<ustring> tags) {
     notmuch_message_t * msg;
 
@@ -424,6 +636,94 @@ namespace Astroid {
     return (st == NOTMUCH_STATUS_SUCCESS) && (c == 1);
   }
 
+  void Db::on_threads_in_query (
+      ustring query_in,
+      const std::vector<ustring> & thread_ids,
+      function<void(notmuch_thread_t *)> func)
+  {
+    UstringUtils::trim(query_in);
+
+    bool all = (query_in.length() == 0 || query_in == "*");
+
+    time_t t0 = clock ();
+
+    for (unsigned int i = 0; i < thread_ids.size (); i += THREADS_PER_QUERY) {
+      string threads_s;
+
+      for (unsigned int j = i; j < thread_ids.size () && j < i + THREADS_PER_QUERY; j++) {
+        if (!threads_s.empty ()) threads_s += " OR ";
+        threads_s += "thread:" + thread_ids[j];
+      }
+
+      string query_s;
+
+      if (all) {
+        query_s = threads_s;
+      } else {
+        query_s = "(" + threads_s + ") AND (" + query_in + ")";
+      }
+
+      notmuch_query_t * query = notmuch_query_create (nm_db, query_s.c_str());
+      for (ustring &t : excluded_tags) {
+        notmuch_query_add_tag_exclude (query, t.c_str());
+      }
+      notmuch_query_set_omit_excluded (query, NOTMUCH_EXCLUDE_TRUE);
+
+      notmuch_threads_t * threads;
+      notmuch_thread_t  * thread;
+      notmuch_status_t st = notmuch_query_search_threads (query, &threads);
+
+      for (;
+           (st == NOTMUCH_STATUS_SUCCESS) && notmuch_threads_valid (threads);
+           notmuch_threads_move_to_next (threads)) {
+
+        thread = notmuch_threads_get (threads);
+        func (thread);
+        notmuch_thread_destroy (thread);
+      }
+
+      /* free resources */
+      notmuch_query_destroy (query);
+    }
+
+    LOG (debug) << "db: " << thread_ids.size () << " threads in query check: " << ((clock() - t0) * 1000.0 / CLOCKS_PER_SEC) << " ms.";
+  }
+
+  std::string Db::first_message_id (ustring query_in, ustring thread_id) {
+    string query_s;
+
+    UstringUtils::trim(query_in);
+
+    if (query_in.length() == 0 || query_in == "*") {
+      query_s = "thread:" + thread_id;
+    } else {
+      query_s = "thread:" + thread_id  + " AND (" + query_in + ")";
+    }
+
+    notmuch_query_t * query = notmuch_query_create (nm_db, query_s.c_str());
+    for (ustring &t : excluded_tags) {
+      notmuch_query_add_tag_exclude (query, t.c_str());
+    }
+    notmuch_query_set_omit_excluded (query, NOTMUCH_EXCLUDE_TRUE);
+    notmuch_query_set_sort (query, NOTMUCH_SORT_MESSAGE_ID);
+
+    string mid;
+    notmuch_messages_t * messages;
+
+    notmuch_status_t st = notmuch_query_search_messages (query, &messages);
+
+    if (st == NOTMUCH_STATUS_SUCCESS && notmuch_messages_valid (messages)) {
+      notmuch_message_t * m = notmuch_messages_get (messages);
+      mid = notmuch_message_get_message_id (m);
+      notmuch_message_destroy (m);
+    }
+
+    /* free resources */
+    notmuch_query_destroy (query);
+
+    return mid;
+  }
+
   void Db::on_thread (ustring thread_id, function<void(notmuch_thread_t *)> func) {
 
     string query_s = "thread:" + thread_id;
@@ -524,6 +824,8 @@ namespace Astroid {
    * notmuch thread
    * --------------
    */
+  std::atomic<unsigned long> NotmuchThread::versions { 0 };
+
   NotmuchThread::NotmuchThread (notmuch_thread_t * t) {
     const char * ti = notmuch_thread_get_thread_id (t);
     if (ti == NULL) {
@@ -568,6 +870,10 @@ namespace Astroid {
     total_messages = check_total_messages (nm_thread);
     tags        = get_tags (nm_thread);
     authors     = get_authors (nm_thread);
+
+    make_index_str ();
+
+    version = ++versions;
   }
 
   vector<ustring> NotmuchThread::get_tags (notmuch_thread_t * nm_thread) {
@@ -744,6 +1050,8 @@ namespace Astroid {
 
           if (res) {
             tags.push_back (tag);
+            make_index_str ();
+            version = ++versions;
 
             // add to global tag list
             if (find(db->tags.begin (),
@@ -809,6 +1117,8 @@ namespace Astroid {
             tags.erase (remove (tags.begin (),
                                 tags.end (),
                                 tag), tags.end ());
+            make_index_str ();
+            version = ++versions;
           }
 
           res = true;
@@ -822,24 +1132,44 @@ namespace Astroid {
   }
 
 
+  void NotmuchThread::apply_tags (const vector<ustring> & _add, const vector<ustring> & _remove) {
+    NotmuchItem::apply_tags (_add, _remove);
+
+    make_index_str ();
+    version = ++versions;
+  }
+
   void NotmuchThread::emit_updated (Db * db) {
     astroid->actions->emit_thread_updated (db, thread_id);
   }
 
+  void NotmuchThread::make_index_str () {
+    ustring i = subject;
+    for (auto &a : authors)  i += get<0>(a);
+    for (auto &t : tags)     i += t;
+    i += thread_id;
+
+    index_str = std::make_shared<const std::string> (i.lowercase ().raw ());
+  }
+
+  std::shared_ptr<const std::string> NotmuchThread::get_index_str () {
+    return index_str;
+  }
+
   bool NotmuchThread::matches (std::vector<ustring> &k) {
-    if (index_str.empty ()) {
-      index_str = subject;
-      for (auto &a : authors)  index_str += get<0>(a);
-      for (auto &t : tags)     index_str += t;
-      index_str += thread_id;
-      index_str = index_str.lowercase ();
-    }
+    std::vector<std::string> keys;
+    for (auto &kk : k) keys.push_back (kk.raw ());
 
-    /* match all keys (AND) */
-    return std::all_of (k.begin (), k.end (),
-        [&] (ustring &kk)
+    return matches (*index_str, keys);
+  }
+
+  bool NotmuchThread::matches (const std::string & haystack, const std::vector<std::string> & keys) {
+    /* match all keys (AND), a byte-wise search is sufficient since both
+     * haystack and keys are valid utf-8 */
+    return std::all_of (keys.begin (), keys.end (),
+        [&] (const std::string &kk)
           {
-            return index_str.find (kk) != string::npos;
+            return haystack.find (kk) != string::npos;
           });
   }
 
@@ -1065,8 +1395,18 @@ namespace Astroid {
     return res;
   }
 
+  void NotmuchMessage::apply_tags (const vector<ustring> & _add, const vector<ustring> & _remove) {
+    NotmuchItem::apply_tags (_add, _remove);
+
+    index_str = "";
+  }
+
   void NotmuchMessage::emit_updated (Db * db) {
-    astroid->actions->emit_message_updated (db, mid);
+    if (!thread_id.empty ()) {
+      astroid->actions->emit_message_updated (db, mid, thread_id);
+    } else {
+      astroid->actions->emit_message_updated (db, mid);
+    }
   }
 
   bool NotmuchMessage::in_query (Db * db, ustring query) {
@@ -1085,6 +1425,22 @@ namespace Astroid {
     return (find(tags.begin (), tags.end (), tag) != tags.end ());
   }
 
+  void NotmuchItem::apply_tags (const vector<ustring> & _add, const vector<ustring> & _remove) {
+    for (auto & t : _add) {
+      if (!has_tag (t)) tags.push_back (t);
+    }
+
+    for (auto & t : _remove) {
+      tags.erase (std::remove (tags.begin (), tags.end (), t), tags.end ());
+    }
+
+    sort (tags.begin (), tags.end ());
+
+    unread     = has_tag ("unread");
+    attachment = has_tag ("attachment");
+    flagged    = has_tag ("flagged");
+  }
+
   /***************
    * Exceptions
    ***************/
@@ -4,6 +4,11 @@
 # include <condition_variable>
 # include <atomic>
 # include <functional>
+# include <memory>
+# include <map>
+# include <deque>
+# include <thread>
+# include <chrono>
 
 # include <vector>
 
@@ -47,6 +52,10 @@ namespace Astroid {
       virtual bool remove_tag (Db *, ustring) = 0;
       virtual bool add_tag (Db *, ustring)    = 0;
 
+      /* change the tags of the in-memory item only, the db is written
+       * later (see TagJournal) */
+      virtual void apply_tags (const std::vector<ustring> & add, const std::vector<ustring> & remove);
+
       virtual void emit_updated (Db *) = 0;
 
       virtual ustring str () = 0;
@@ -71,6 +80,7 @@ namespace Astroid {
 
       bool remove_tag (Db *, ustring)   override;
       bool add_tag (Db *, ustring)      override;
+      void apply_tags (const std::vector<ustring> &, const std::vector<ustring> &) override;
       void emit_updated (Db *)          override;
 
       ustring str () override;
@@ -94,23 +104,40 @@ namespace Astroid {
       int     total_messages;
       std::vector<std::tuple<ustring,bool>> authors;
 
+      /* changed whenever the thread is (re-)loaded or its tags change, so
+       * that derived data (e.g. rendered rows) can be invalidated. the
+       * versions are unique over all threads, so that a thread that is
+       * re-created does not get the version of the one it replaces. */
+      unsigned long version = 0;
+      static std::atomic<unsigned long> versions;
+
       void load (notmuch_thread_t *);
       void refresh (Db *) override;
 
       bool remove_tag (Db *, ustring) override;
       bool add_tag (Db *, ustring) override;
+      void apply_tags (const std::vector<ustring> &, const std::vector<ustring> &) override;
       void emit_updated (Db *) override;
 
       ustring str () override;
       bool matches (std::vector<ustring> &k) override;
       bool in_query (Db *, ustring) override;
 
+      /* lowercase haystack for filtering, built on load (usually on the
+       * loader thread). it is replaced rather than modified, so a copy may be
+       * handed to another thread. */
+      std::shared_ptr<const std::string> get_index_str ();
+
+      /* match all (lowercase) keys against haystack */
+      static bool matches (const std::string & haystack, const std::vector<std::string> & keys);
+
     private:
       int check_total_messages (notmuch_thread_t *);
       std::vector<std::tuple<ustring,bool>> get_authors (notmuch_thread_t *);
       std::vector<ustring> get_tags (notmuch_thread_t *);
 
-      ustring index_str = "";
+      std::shared_ptr<const std::string> index_str;
+      void make_index_str ();
   };
 
   class Db {
@@ -130,6 +157,16 @@ namespace Astroid {
       bool thread_in_query (ustring, ustring);
       bool message_in_query (ustring, ustring);
 
+      /* call func for each of the threads that match query, the threads
+       * are looked up in a few queries rather than one query per thread. */
+      void on_threads_in_query (ustring query, const std::vector<ustring> & thread_ids,
+          std::function <void(notmuch_thread_t *)>);
+
+      /* the lowest message id of the messages in thread that match query,
+       * which is the position of the thread in a message id sorted
+       * query. empty if none match. */
+      std::string first_message_id (ustring query, ustring thread_id);
+
       unsigned long get_revision ();
 
       notmuch_database_t * nm_db;
@@ -145,18 +182,35 @@ namespace Astroid {
       ustring add_sent_message (ustring, std::vector<ustring>);
       ustring add_draft_message (ustring);
       ustring add_message_with_tags (ustring fname, std::vector<ustring> tags);
+
+      /* index a file found in a maildir like notmuch new: new messages get
+       * new_tags, and the tags of the message are set from the maildir
+       * flags if they are synchronized. false if the file could not be
+       * indexed. */
+      bool index_file (ustring fname, const std::vector<ustring> & new_tags);
       bool remove_message (ustring);
 
       static ustring sanitize_tag (ustring);
       static bool check_tag (ustring);
 
       /* lock db: use if you need the db in external program and need
-       * a specific lock */
-      static std::unique_lock<std::mutex> acquire_rw_lock ();
-      static void release_rw_lock (std::unique_lock<std::mutex> &);
+       * a specific lock. returns the id of the lock, which is passed on
+       * when releasing it. */
+      static unsigned long acquire_rw_lock ();
+      static void release_rw_lock (unsigned long);
+
+      static unsigned long acquire_ro_lock ();
+      static void release_ro_lock (unsigned long);
 
-      static void acquire_ro_lock ();
-      static void release_ro_lock ();
+      /* log the wait and hold times of the locks, and who holds the locks
+       * now and for how long */
+      static void log_locks ();
+
+      /* the revisions written by the read-write dbs of astroid are kept,
+       * so that a watcher of the db can tell its own changes from those of
+       * others. returns the first revision after from that was not written
+       * by astroid. */
+      static unsigned long skip_written (unsigned long from);
 
       static bool maildir_synchronize_flags;
       static void init ();
@@ -171,22 +225,75 @@ namespace Astroid {
        *  + It is not possible to have read-only db's open when there is a
        *    read-write db open.
        *
+       * Read-write dbs are served in the order they are requested, and a
+       * read-only db requested while a read-write db is waiting waits for
+       * it, so that read-write dbs are not held up by a steady stream of
+       * read-only dbs. Threads that already hold a read-only db get another
+       * one right away, since the read-write db waits for them. So does the
+       * gui thread, which only keeps its read-only dbs open briefly, so that
+       * it does not freeze while a read-write db waits for a long read-only
+       * db of another thread.
+       *
        * If you open one read-only db, and try to open a read-write db in the
-       * same thread without closing the read-only db there will be a deadlock.
+       * same thread without closing the read-only db there would be a
+       * deadlock: this (and the other way around) throws a database_error
+       * and logs the holders of the locks.
        *
        */
+      struct LockHolder {
+        bool                                  rw;
+        std::thread::id                       thread;
+        std::chrono::steady_clock::time_point since;
+      };
 
-      /* number of open read-only dbs, when 0 a read-write can be opened */
-      static std::atomic<int>         read_only_dbs_open;
+      struct LockStats {
+        unsigned long count = 0;
+        double        wait_total = 0; // ms
+        double        wait_max   = 0; // ms
+        double        held_total = 0; // ms
+        double        held_max   = 0; // ms
+      };
+
+      /* protects the lock state below, lock_cv is notified when a lock
+       * is released */
+      static std::mutex               lock_m;
+      static std::condition_variable  lock_cv;
+
+      static std::map<unsigned long, LockHolder> lock_holders;
+      static unsigned long            next_lock_id;
+      static int                      read_only_dbs_open;
+      static bool                     read_write_db_open;
+
+      /* read-write dbs take a ticket, and get the lock in order */
+      static unsigned long            rw_tickets;
+      static unsigned long            rw_serving;
+
+      static LockStats                ro_stats;
+      static LockStats                rw_stats;
+
+      /* the gui thread, for the lock report */
+      static std::thread::id          gui_thread;
 
-      /* synchronizes openings, read-write dbs will lock this for
-       * its entire lifespan. read-only, only locks it while incrementing
-       * the read_only_dbs_open */
-      static std::mutex               db_open;
+      /* lock_m must be held for these */
+      static bool holds_lock (std::thread::id, bool rw);
+      static void log_holders ();
+      static unsigned long add_holder (bool rw, std::chrono::steady_clock::time_point requested);
+      static void wait_lock (std::unique_lock<std::mutex> &, const char * what, std::function<bool()>);
 
-      /* notify when read_only_dbs change */
-      static std::condition_variable  dbs_open;
-      std::unique_lock<std::mutex>    rw_lock;
+      static void release_lock (unsigned long);
+
+      /* the revision ranges (opened, closed) of the read-write dbs, at most
+       * WRITTEN_MAX */
+      static std::mutex written_m;
+      static std::deque<std::pair<unsigned long, unsigned long>> written;
+      static const unsigned int WRITTEN_MAX = 1000;
+
+      unsigned long opened_revision = 0;
+
+      /* log the holders when waiting for a lock longer than this */
+      static const int lock_report_delay = 10; // seconds
+
+      unsigned long lock_id = 0;
 
       DbMode mode;
 
@@ -194,6 +301,9 @@ namespace Astroid {
       bool open_db_read_only (bool);
       bool closed = false;
 
+      /* thread ids per query in on_threads_in_query */
+      static const unsigned int THREADS_PER_QUERY = 200;
+
       const int db_open_timeout = 120; // seconds
       const int db_open_delay   = 1;   // seconds
 
@@ -0,0 +1,198 @@
+# include <vector>
+# include <string>
+# include <chrono>
+
+# include <notmuch.h>
+
+# include "astroid.hh"
+# include "indexer.hh"
+# include "db.hh"
+# include "config.hh"
+# include "utils/vector_utils.hh"
+
+using namespace std;
+
+namespace Astroid {
+  Indexer::Indexer () {
+    LOG (info) << "indexer: setting up.";
+
+    batch_delay = (int) (astroid->config ().get<double> ("poll.watch_delay") * 1000);
+
+    ustring tags_s = "unread;inbox";
+    try {
+      tags_s = ustring (astroid->notmuch_config ().get<string> ("new.tags"));
+    } catch (const boost::property_tree::ptree_bad_path &ex) {
+      LOG (warn) << "indexer: no new.tags in notmuch config, using: " << tags_s;
+    }
+    new_tags = VectorUtils::split_and_trim (tags_s, ";");
+
+    indexed_ready.connect (
+        sigc::mem_fun (this, &Indexer::on_indexed_ready));
+
+    for (auto & f : maildir_folders (Db::path_db, true)) {
+      try {
+        auto m = Gio::File::create_for_path (f.c_str ())->monitor_directory ();
+        m->signal_changed ().connect (sigc::mem_fun (this, &Indexer::on_changed));
+        monitors.push_back (m);
+
+      } catch (Glib::Error &ex) {
+        LOG (error) << "indexer: could not watch: " << f.c_str () << ": " << ex.what ();
+      }
+    }
+
+    LOG (info) << "indexer: watching " << monitors.size () << " folders.";
+
+    run = true;
+    indexer_t = std::thread (&Indexer::indexer_worker, this);
+  }
+
+  void Indexer::close () {
+    if (!run) return;
+
+    LOG (debug) << "indexer: closing..";
+
+    for (auto & m : monitors) m->cancel ();
+    monitors.clear ();
+
+    /* the pending changes are indexed first */
+    std::unique_lock<std::mutex> lk (changes_m);
+    run = false;
+    lk.unlock ();
+
+    changes_cv.notify_one ();
+    indexer_t.join ();
+  }
+
+  std::vector<bfs::path> Indexer::maildir_folders (bfs::path root, bool cur) {
+    vector<bfs::path> folders;
+    vector<bfs::path> dirs = { root };
+
+    while (!dirs.empty ()) {
+      bfs::path dir = dirs.back ();
+      dirs.pop_back ();
+
+      boost::system::error_code ec;
+
+      for (bfs::directory_iterator d (dir, ec), end; !ec && d != end; d.increment (ec)) {
+        if (!bfs::is_directory (d->status ())) continue;
+
+        bfs::path name = d->path ().filename ();
+
+        if (name == "new" || name == "cur") {
+          if (name == "new" || cur) folders.push_back (d->path ());
+
+        } else if (name != ".notmuch" && name != "tmp") {
+          dirs.push_back (d->path ());
+        }
+      }
+    }
+
+    return folders;
+  }
+
+  void Indexer::on_changed (
+      const refptr<Gio::File> & file,
+      const refptr<Gio::File> &,
+      Gio::FileMonitorEvent event_type)
+  {
+    /* renames are reported as deleted and created */
+    if (event_type != Gio::FileMonitorEvent::FILE_MONITOR_EVENT_CREATED &&
+        event_type != Gio::FileMonitorEvent::FILE_MONITOR_EVENT_DELETED) return;
+
+    string fname = file->get_path ();
+    if (fname.empty () || file->get_basename ()[0] == '.') return;
+
+    std::lock_guard<std::mutex> lk (changes_m);
+
+    if (event_type == Gio::FileMonitorEvent::FILE_MONITOR_EVENT_CREATED) {
+      added.push_back (fname);
+    } else {
+      removed.push_back (fname);
+    }
+
+    changes_cv.notify_one ();
+  }
+
+  void Indexer::indexer_worker () {
+    std::unique_lock<std::mutex> lk (changes_m);
+
+    while (run || !added.empty () || !removed.empty ()) {
+      changes_cv.wait (lk, [&] { return (!added.empty () || !removed.empty () || !run); });
+
+      /* collect the changes that follow */
+      if (run) {
+        changes_cv.wait_for (lk, std::chrono::milliseconds (batch_delay), [&] { return !run; });
+      }
+
+      vector<string> a, r;
+      a.swap (added);
+      r.swap (removed);
+
+      lk.unlock ();
+
+      if (!a.empty () || !r.empty ()) index (a, r);
+
+      lk.lock ();
+    }
+  }
+
+  void Indexer::index (const vector<string> & a, const vector<string> & r) {
+    auto t0 = chrono::steady_clock::now ();
+
+    unsigned long before;
+    unsigned int n = 0;
+
+    try {
+      Db db (Db::DbMode::DATABASE_READ_WRITE);
+
+      before = db.get_revision ();
+
+      notmuch_database_begin_atomic (db.nm_db);
+
+      for (auto & f : a) {
+        if (db.index_file (f, new_tags)) n++;
+      }
+
+      for (auto & f : r) {
+        try {
+          db.remove_message (f);
+        } catch (database_error &ex) {
+          LOG (error) << "indexer: could not remove: " << f << ": " << ex.what ();
+        }
+      }
+
+      notmuch_database_end_atomic (db.nm_db);
+
+    } catch (database_error &ex) {
+      LOG (error) << "indexer: could not index: " << ex.what ();
+      return;
+    }
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now () - t0;
+    LOG (info) << "indexer: indexed " << n << " of " << a.size () << " added and "
+               << r.size () << " removed files in " << (elapsed.count () * 1000.) << " ms.";
+
+    std::unique_lock<std::mutex> lk (indexed_m);
+    indexed.push_back (before);
+    lk.unlock ();
+
+    indexed_ready.emit ();
+  }
+
+  void Indexer::on_indexed_ready () {
+    /* runs on gui thread */
+    std::unique_lock<std::mutex> lk (indexed_m);
+    if (indexed.empty ()) return;
+
+    unsigned long before = indexed.front ();
+    indexed.clear ();
+    lk.unlock ();
+
+    m_signal_indexed.emit (before);
+  }
+
+  Indexer::type_signal_indexed Indexer::signal_indexed () {
+    return m_signal_indexed;
+  }
+}
+
@@ -0,0 +1,72 @@
+# pragma once
+
+# include <vector>
+# include <string>
+# include <thread>
+# include <mutex>
+# include <condition_variable>
+# include <deque>
+
+# include <glibmm.h>
+# include <giomm/file.h>
+# include <giomm/filemonitor.h>
+# include <sigc++/sigc++.h>
+# include <boost/filesystem.hpp>
+
+# include "proto.hh"
+
+namespace bfs = boost::filesystem;
+
+namespace Astroid {
+  /* indexes the files that are added to or removed from the new/ and cur/
+   * folders of the maildirs below the database path, as an alternative to
+   * waiting for a poll that runs notmuch new over the whole tree.
+   *
+   * the changes are collected for batch_delay and indexed on a worker
+   * thread in one atomic transaction. files that are added are indexed
+   * before files that are removed, so that a message that is moved (e.g.
+   * from new/ to cur/) keeps its tags. new messages get the tags in
+   * new.tags of the notmuch config.
+   *
+   * files that are added while astroid is not running are only picked up
+   * by a poll. */
+  class Indexer {
+    public:
+      Indexer ();
+      void close ();
+
+      /* the new/ (and cur/) folders of the maildirs below root */
+      static std::vector<bfs::path> maildir_folders (bfs::path root, bool cur);
+
+      /* emitted on the gui thread when a batch has been indexed, with the
+       * revision of the database before the batch */
+      typedef sigc::signal <void, unsigned long> type_signal_indexed;
+      type_signal_indexed signal_indexed ();
+
+    private:
+      std::vector<ustring> new_tags;
+      int batch_delay; // ms
+
+      std::vector<refptr<Gio::FileMonitor>> monitors;
+      void on_changed (const refptr<Gio::File> &, const refptr<Gio::File> &, Gio::FileMonitorEvent);
+
+      bool run = false;
+      std::thread indexer_t;
+      void indexer_worker ();
+      void index (const std::vector<std::string> & added, const std::vector<std::string> & removed);
+
+      std::mutex changes_m;
+      std::condition_variable changes_cv;
+      std::vector<std::string> added;
+      std::vector<std::string> removed;
+
+      std::mutex indexed_m;
+      std::deque<unsigned long> indexed; // revisions before the batches
+      Glib::Dispatcher indexed_ready;
+      void on_indexed_ready ();
+
+    protected:
+      type_signal_indexed m_signal_indexed;
+  };
+}
+
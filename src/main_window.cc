@@ -60,6 +60,8 @@ namespace Astroid {
 
     astroid->poll->signal_poll_state ().connect (
         sigc::mem_fun (this, &Notebook::poll_state_changed));
+    astroid->poll->signal_poll_progress ().connect (
+        sigc::mem_fun (this, &Notebook::poll_progress));
     signal_size_allocate ().connect (
         sigc::mem_fun (this, &Notebook::on_my_size_allocate));
 
@@ -79,11 +81,16 @@ namespace Astroid {
       poll_spinner.start ();
     } else if (!state && spinner_on) {
       poll_spinner.stop ();
+      poll_spinner.set_tooltip_text ("");
       icons.remove (poll_spinner);
       spinner_on = false;
     }
   }
 
+  void Notebook::poll_progress (ustring progress) {
+    poll_spinner.set_tooltip_text (progress);
+  }
+
   void Notebook::add_widget (Gtk::Widget * w) {
     icons.pack_start (*w, true, true, 5);
     w->show ();
@@ -47,6 +47,7 @@ namespace Astroid {
       bool spinner_on = false;
 
       void poll_state_changed (bool);
+      void poll_progress (ustring);
 
       void on_my_size_allocate (Gtk::Allocation &);
   };
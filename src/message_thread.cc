@@ -16,6 +16,7 @@
 # include "utils/ustring_utils.hh"
 # include "utils/vector_utils.hh"
 # include "actions/action_manager.hh"
+# include "utils/message_prefetch.hh"
 
 using namespace std;
 using namespace boost::filesystem;
@@ -166,6 +167,14 @@ namespace Astroid {
       return;
 
     } else {
+      /* the message may have been parsed already by the prefetcher */
+      GMimeMessage * prefetched = (astroid->prefetch ? astroid->prefetch->take (fname) : NULL);
+      if (prefetched != NULL) {
+        load_message (prefetched);
+        g_object_unref (prefetched); // is reffed in load_message
+        return;
+      }
+
       GError *err = NULL; (void) (err); // not used in GMime 2.
       GMimeStream   * stream  = g_mime_stream_file_open (fname.c_str(), "r", &err);
       g_mime_stream_file_set_owner (GMIME_STREAM_FILE(stream), TRUE);
@@ -843,6 +852,12 @@ namespace Astroid {
 
     astroid->actions->signal_thread_changed ().connect (
         sigc::mem_fun (this, &MessageThread::on_thread_changed));
+
+    astroid->actions->signal_threads_updated ().connect (
+        sigc::mem_fun (this, &MessageThread::on_threads_updated));
+
+    astroid->actions->signal_threads_changed ().connect (
+        sigc::mem_fun (this, &MessageThread::on_threads_changed));
   }
 
   MessageThread::~MessageThread () {
@@ -884,6 +899,28 @@ namespace Astroid {
     }
   }
 
+  void MessageThread::on_threads_updated (Db * db, const std::vector<ustring> & tids) {
+    if (!in_notmuch) return;
+
+    for (auto & tid : tids) {
+      if (tid == thread->thread_id) {
+        on_thread_updated (db, tid);
+        return;
+      }
+    }
+  }
+
+  void MessageThread::on_threads_changed (Db * db, const std::vector<ustring> & tids) {
+    if (!in_notmuch) return;
+
+    for (auto & tid : tids) {
+      if (tid == thread->thread_id) {
+        on_thread_changed (db, tid);
+        return;
+      }
+    }
+  }
+
   void MessageThread::on_thread_changed (Db * db, ustring tid) {
     if (in_notmuch && tid == thread->thread_id) {
       thread->refresh (db);
@@ -132,6 +132,8 @@ namespace Astroid {
 
       void on_thread_updated (Db * db, ustring tid);
       void on_thread_changed (Db * db, ustring tid);
+      void on_threads_updated (Db * db, const std::vector<ustring> & tids);
+      void on_threads_changed (Db * db, const std::vector<ustring> & tids);
 
     public:
       refptr<NotmuchThread> thread;
@@ -12,6 +12,8 @@
 # include <boost/log/support/date_time.hpp>
 
 # include "log_view.hh"
+# include "db.hh"
+# include "actions/action_manager.hh"
 
 namespace logging = boost::log;
 namespace sinks   = boost::log::sinks;
@@ -128,6 +130,22 @@ namespace Astroid {
           return true;
         });
 
+    keys.register_key ("d",
+        "log.db_locks",
+        "Show the db locks: who holds them, and wait and hold times",
+        [&] (Key) {
+          Db::log_locks ();
+          return true;
+        });
+
+    keys.register_key ("a",
+        "log.action_stats",
+        "Show the queued actions, and their wait and run times",
+        [&] (Key) {
+          astroid->actions->log_stats ();
+          return true;
+        });
+
     keys.loghandle = false;
   }
 
@@ -464,6 +464,12 @@ namespace Astroid {
     astroid->actions->signal_thread_changed ().connect (
         sigc::mem_fun (this, &SavedSearches::on_thread_changed));
 
+    astroid->actions->signal_threads_updated ().connect (
+        sigc::mem_fun (this, &SavedSearches::on_threads_changed));
+
+    astroid->actions->signal_threads_changed ().connect (
+        sigc::mem_fun (this, &SavedSearches::on_threads_changed));
+
     astroid->actions->signal_refreshed ().connect (
         sigc::mem_fun (this, &SavedSearches::reload));
   }
@@ -517,6 +523,10 @@ namespace Astroid {
     refresh_stats_db (db);
   }
 
+  void SavedSearches::on_threads_changed (Db * db, const std::vector<ustring> &) {
+    refresh_stats_db (db);
+  }
+
   void SavedSearches::refresh_stats () {
     Db db;
     refresh_stats_db (&db);
@@ -31,6 +31,7 @@ namespace Astroid {
       static Glib::Dispatcher m_reload;
 
       void on_thread_changed (Db *, ustring);
+      void on_threads_changed (Db *, const std::vector<ustring> &);
       void load_startup_queries ();
       void load_saved_searches ();
       void add_query (ustring, ustring, bool saved = false, bool history = false);
@@ -11,6 +11,10 @@
 # include <queue>
 # include <mutex>
 # include <functional>
+# include <chrono>
+# include <algorithm>
+# include <unordered_map>
+# include <unordered_set>
 
 # include <notmuch.h>
 
@@ -23,23 +27,20 @@ namespace Astroid {
     id = nextid++;
 
     ustring sort_order = astroid->config ().get<std::string> ("thread_index.sort_order");
-    if (sort_order == "newest") {
-      sort = NOTMUCH_SORT_NEWEST_FIRST;
-    } else if (sort_order == "oldest") {
-      sort = NOTMUCH_SORT_OLDEST_FIRST;
-    } else if (sort_order == "messageid") {
-      sort = NOTMUCH_SORT_MESSAGE_ID;
-    } else if (sort_order == "unsorted") {
-      sort = NOTMUCH_SORT_UNSORTED;
+    auto s = std::find (sort_strings.begin (), sort_strings.end (), sort_order);
+
+    if (s != sort_strings.end ()) {
+      sort = static_cast<ThreadIndexListStore::SortOrder> (s - sort_strings.begin ());
     } else {
-      LOG (error) << "ti: unknown sort order, must be 'newest', 'oldest', 'messageid' or 'unsorted': " << sort_order << ", using 'newest'.";
-      sort = NOTMUCH_SORT_NEWEST_FIRST;
+      LOG (error) << "ti: unknown sort order, must be 'newest', 'oldest', 'messageid', 'unsorted', 'messages' or 'author': " << sort_order << ", using 'newest'.";
+      sort = ThreadIndexListStore::SortNewest;
     }
 
     loaded_threads = 0;
     total_messages = 0;
     unread_messages = 0;
     run = false;
+    to_list_pending = false;
 
     queue_has_data.connect (
         sigc::mem_fun (this, &QueryLoader::to_list_adder));
@@ -50,6 +51,12 @@ namespace Astroid {
     astroid->actions->signal_thread_changed ().connect (
         sigc::mem_fun (this, &QueryLoader::on_thread_changed));
 
+    astroid->actions->signal_threads_updated ().connect (
+        sigc::mem_fun (this, &QueryLoader::on_threads_updated));
+
+    astroid->actions->signal_threads_changed ().connect (
+        sigc::mem_fun (this, &QueryLoader::on_threads_updated));
+
     astroid->actions->signal_refreshed ().connect (
         sigc::mem_fun (this, &QueryLoader::on_refreshed));
   }
@@ -78,11 +85,17 @@ namespace Astroid {
 
   void QueryLoader::reload () {
     stop ();
-    std::lock_guard<std::mutex> lk (to_list_m);
-    list_store->clear ();
 
-    while (!to_list_store.empty ())
-      to_list_store.pop ();
+    add_batch_c.disconnect ();
+    to_add.clear ();
+
+    std::unique_lock<std::mutex> lk (to_list_m);
+    std::queue<refptr<NotmuchThread>> ().swap (to_list_store);
+    to_list_pending = false;
+    lk.unlock ();
+
+    list_store->clear ();
+    list_view->clear_filter_results ();
 
     start (query);
   }
@@ -121,6 +134,8 @@ namespace Astroid {
     std::lock_guard<std::mutex> loader_lk (loader_m);
 
     Db db (Db::DATABASE_READ_ONLY);
+    loader_revision = db.get_revision ();
+
     refresh_stats_db (&db);
     if (!in_destructor) stats_ready.emit ();
 
@@ -134,7 +149,7 @@ namespace Astroid {
     }
 
     notmuch_query_set_omit_excluded (nmquery, NOTMUCH_EXCLUDE_TRUE);
-    notmuch_query_set_sort (nmquery, sort);
+    notmuch_query_set_sort (nmquery, query_sort ());
 
     /* slow */
     notmuch_status_t st = NOTMUCH_STATUS_SUCCESS;
@@ -172,8 +187,10 @@ namespace Astroid {
 
       i++;
 
-      if ((i % 100) == 0) {
-        if (run && !in_destructor)
+      /* wake up the gui for the first thread, and then regularly unless it
+       * has not yet taken the queue */
+      if (i == 1 || (i % 100) == 0) {
+        if (run && !in_destructor && !to_list_pending.exchange (true))
           queue_has_data.emit ();
       }
     }
@@ -195,46 +212,121 @@ namespace Astroid {
       deferred_threads_d.emit ();
   }
 
+  void QueryLoader::take_queue () {
+    std::queue<refptr<NotmuchThread>> q;
+
+    std::unique_lock<std::mutex> lk (to_list_m);
+    q.swap (to_list_store);
+    to_list_pending = false;
+    lk.unlock ();
+
+    while (!q.empty ()) {
+      to_add.push_back (q.front ());
+      q.pop ();
+    }
+  }
+
   void QueryLoader::to_list_adder () {
-    std::lock_guard<std::mutex> lk (to_list_m);
+    take_queue ();
+
+    if (to_add.empty () || add_batch_c.connected ()) return;
+
+    /* add the first batch right away, the rest when idle */
+    if (add_batch ()) {
+      add_batch_c = Glib::signal_idle ().connect (
+          sigc::mem_fun (this, &QueryLoader::add_batch));
+    }
+  }
+
+  bool QueryLoader::add_batch () {
+    if (in_destructor) return false;
+
+    unsigned int n = std::min<size_t> (batch_size, to_add.size ());
 
-    while (!to_list_store.empty ()) {
-      refptr<NotmuchThread> t = to_list_store.front ();
-      to_list_store.pop ();
+    if (n > 0) {
+      std::vector<refptr<NotmuchThread>> threads (to_add.begin (), to_add.begin () + n);
+      to_add.erase (to_add.begin (), to_add.begin () + n);
 
-      auto iter = list_store->append ();
-      Gtk::ListStore::Row row = *iter;
+      auto t0 = std::chrono::steady_clock::now ();
 
-      row[list_store->columns.newest_date] = t->newest_date;
-      row[list_store->columns.oldest_date] = t->oldest_date;
-      row[list_store->columns.thread_id]   = t->thread_id;
-      row[list_store->columns.thread]      = t;
+      /* when the batch is larger than the list the view is detached: it is
+       * cheaper for it to build all its rows at once than to track every
+       * insertion. */
+      bool detach = n > list_store->size ();
+
+      Gtk::TreePath path;
+      Gtk::TreeViewColumn *c;
+
+      if (detach) {
+        list_view->get_cursor (path, c);
+        list_view->unset_model ();
+      }
+
+      list_store->append (threads);
+
+      if (detach) {
+        list_view->set_model (list_store);
+        if (path) list_view->set_cursor (path);
+      }
+
+      auto us = std::chrono::duration_cast<std::chrono::microseconds> (
+          std::chrono::steady_clock::now () - t0).count ();
+
+      /* adapt the batch size to the time the last full batch took */
+      if (n == batch_size && us > 0) {
+        double b = n * (BATCH_TIME * 1000.0 / us);
+
+        if (b < MIN_BATCH)      batch_size = MIN_BATCH;
+        else if (b > MAX_BATCH) batch_size = MAX_BATCH;
+        else                    batch_size = (unsigned int) b;
+      }
 
       if (loaded_threads == 0) {
         if (!in_destructor)
           first_thread_ready.emit ();
       }
 
-      loaded_threads++;
+      bool report = (loaded_threads / 100) != ((loaded_threads + n) / 100);
+      loaded_threads += n;
 
-      if ((loaded_threads % 100) == 0) {
-        LOG (debug) << "ql: loaded " << loaded_threads << " threads.";
+      if (report) {
+        LOG (debug) << "ql: loaded " << loaded_threads << " threads (batch: " << batch_size << ").";
         if (!in_destructor && !list_view->filter_txt.empty()) stats_ready.emit ();
       }
     }
+
+    if (to_add.empty ()) {
+      /* the loader is done: apply the changes that came in meanwhile */
+      if (!run && !changed_threads.empty ()) update_deferred_changed_threads ();
+      return false;
+    }
+
+    return true;
   }
 
   void QueryLoader::update_deferred_changed_threads () {
-    /* lock and check for changed threads */
-    if (!in_destructor) {
-      Db db (Db::DATABASE_READ_ONLY);
+    /* wait for the remaining threads to be added to the list */
+    to_list_adder ();
+    if (!to_add.empty ()) return;
 
-      while (!changed_threads.empty ()) {
-        ustring tid = changed_threads.front ();
-        changed_threads.pop ();
-        LOG (debug) << "ql: deferred update of: " << tid;
-        on_thread_changed (&db, tid);
-      }
+    if (in_destructor || changed_threads.empty ()) return;
+
+    /* the threads were loaded from a db that may already have had the
+     * changes signalled before it was opened */
+    std::vector<ustring> thread_ids;
+
+    for (auto & c : changed_threads) {
+      if (c.second > loader_revision) thread_ids.push_back (c.first);
+    }
+
+    LOG (debug) << "ql: deferred update of: " << thread_ids.size () << " of "
+                << changed_threads.size () << " changed threads.";
+
+    changed_threads.clear ();
+
+    if (!thread_ids.empty ()) {
+      Db db (Db::DATABASE_READ_ONLY);
+      on_threads_changed (&db, thread_ids);
     }
   }
 
@@ -242,6 +334,23 @@ namespace Astroid {
     return run;
   }
 
+  bool QueryLoader::complete () {
+    if (run || !to_add.empty ()) return false;
+
+    std::lock_guard<std::mutex> lk (to_list_m);
+    return to_list_store.empty ();
+  }
+
+  notmuch_sort_t QueryLoader::query_sort () {
+    if (ThreadIndexListStore::sortable (sort) &&
+        sort != ThreadIndexListStore::SortOldest &&
+        sort != ThreadIndexListStore::SortNewest) {
+      return NOTMUCH_SORT_NEWEST_FIRST;
+    }
+
+    return static_cast<notmuch_sort_t> (sort);
+  }
+
   /***************
    * signals
    **************/
@@ -257,120 +366,129 @@ namespace Astroid {
 
     LOG (info) << "ql (" << id << "): " << query << ", got changed thread signal: " << thread_id;
 
-    if (loading ()) {
-      LOG (debug) << "ql: still loading, deferring thread_changed to until load is done.";
-      changed_threads.push (thread_id);
+    on_threads_changed (db, std::vector<ustring> { thread_id });
+  }
+
+  void QueryLoader::on_threads_updated (Db * db, const std::vector<ustring> & thread_ids) {
+    if (in_destructor) return;
+
+    LOG (info) << "ql (" << id << "): " << query << ", got updated threads signal: " << thread_ids.size () << " threads.";
+
+    on_threads_changed (db, thread_ids);
+  }
+
+  void QueryLoader::on_threads_changed (Db * db, const std::vector<ustring> & thread_ids) {
+    if (in_destructor || thread_ids.empty ()) return;
+
+    if (loading () || !to_add.empty ()) {
+      /* the loader will have or has had the changes that are older than
+       * its db */
+      unsigned long rev = db->get_revision ();
+      if (rev <= loader_revision) return;
+
+      LOG (debug) << "ql: still loading, deferring changes to " << thread_ids.size () << " threads until load is done.";
+
+      for (auto & t : thread_ids) {
+        unsigned long & r = changed_threads[t.raw ()];
+        r = std::max (r, rev);
+      }
+
       return;
     }
 
-    /* we now have three options:
+    /* we now have three options for each thread:
      * - a new thread has been added (unlikely)
      * - a thread has been deleted (kind of likely)
      * - a thread has been updated (most likely)
      *
      * none of them needs to affect the threads that match the query in this
-     * list.
+     * list. the loaded threads are looked up in one pass over the list, and
+     * the threads that match the query are loaded in a few queries.
      *
      */
 
     time_t t0 = clock ();
 
-    Gtk::TreePath path;
-    Gtk::TreeIter fwditer;
-
-    /* forward iterating is much faster than going backwards:
-     * https://developer.gnome.org/gtkmm/3.11/classGtk_1_1TreeIter.html
-     */
-
-    bool found = false;
-    bool changed = false;
-    fwditer = list_store->get_iter ("0");
+    std::unordered_map<std::string, refptr<NotmuchThread>> loaded;
+    for (auto & t : thread_ids) loaded[t.raw ()] = refptr<NotmuchThread> ();
 
-    Gtk::ListStore::Row row;
+    list_store->for_each_thread ([&] (const refptr<NotmuchThread> & t) {
+        auto l = loaded.find (t->thread_id.raw ());
+        if (l != loaded.end ()) l->second = t;
+      });
 
-    while (fwditer) {
+    LOG (debug) << "ql: updated: found threads in: " << ((clock() - t0) * 1000.0 / CLOCKS_PER_SEC) << " ms.";
 
-      row = *fwditer;
+    /* threads are placed by their first matching message in message id
+     * order, which is looked up in the db */
+    if (sort == ThreadIndexListStore::SortMessageId) {
+      list_store->set_sort_key_func ([&] (const NotmuchThread * t) {
+          return db->first_message_id (query, t->thread_id);
+        });
+    }
 
-      if (row[list_store->columns.thread_id] == thread_id) {
-        found = true;
-        break;
-      }
+    /* get current cursor path, if we are at first row and a new addition
+     * is before we should scroll up. */
+    Gtk::TreePath path;
+    Gtk::TreeViewColumn *c;
+    list_view->get_cursor (path, c);
 
-      fwditer++;
-    }
+    bool was_empty = (list_store->size () == 0);
 
-    /* test if thread is in the current query */
-    bool in_query = db->thread_in_query (query, thread_id);
-
-    if (found) {
-      /* thread has either been updated or deleted from current query */
-      LOG (debug) << "ql: updated: found thread in: " << ((clock() - t0) * 1000.0 / CLOCKS_PER_SEC) << " ms.";
-
-      if (in_query) {
-        /* updated */
-        LOG (debug) << "ql: updated";
-        refptr<NotmuchThread> thread = row[list_store->columns.thread];
-        thread->refresh (db);
-        row[list_store->columns.newest_date] = thread->newest_date;
-        row[list_store->columns.oldest_date] = thread->oldest_date;
-
-      } else {
-        /* deleted */
-        LOG (debug) << "ql: deleted";
-        path = list_store->get_path (fwditer);
-        list_store->erase (fwditer);
-      }
+    std::unordered_set<std::string> in_query;
+    std::unordered_set<const NotmuchThread *> added;
 
-      changed = true;
+    db->on_threads_in_query (query, thread_ids, [&] (notmuch_thread_t * nmt) {
+        std::string tid = notmuch_thread_get_thread_id (nmt);
+        in_query.insert (tid);
 
-    } else {
-      /* thread has possibly been added to the current query */
-      LOG (debug) << "ql: updated: did not find thread, time used: " << ((clock() - t0) * 1000.0 / CLOCKS_PER_SEC) << " ms.";
-      if (in_query) {
-        LOG (debug) << "ql: new thread for query, adding..";
-
-        /* get current cursor path, if we are at first row and the new addition
-         * is before we should scroll up. */
-        Gtk::TreePath path;
-        Gtk::TreeViewColumn *c;
-        list_view->get_cursor (path, c);
+        auto l = loaded.find (tid);
 
-        auto iter = list_store->prepend ();
-        Gtk::ListStore::Row newrow = *iter;
+        if (l != loaded.end () && l->second) {
+          /* updated */
+          l->second->load (nmt);
+          list_store->update (l->second);
 
-        NotmuchThread * t;
+        } else {
+          /* new thread for query */
+          refptr<NotmuchThread> thread (new NotmuchThread (nmt));
+          list_store->insert (thread);
+          added.insert (thread.operator-> ());
+        }
+      });
 
-        db->on_thread (thread_id, [&t](notmuch_thread_t *nmt) {
+    /* the loaded threads that do not match any more */
+    unsigned int deleted = 0;
 
-            t = new NotmuchThread (nmt);
+    for (auto & l : loaded) {
+      if (l.second && !in_query.count (l.first)) {
+        list_store->erase (l.second);
+        list_view->erase_filter_result (l.second);
+        deleted++;
+      }
+    }
 
-          });
+    list_store->set_sort_key_func (ThreadIndexListStore::SlotSortKey ());
 
-        newrow[list_store->columns.newest_date] = t->newest_date;
-        newrow[list_store->columns.oldest_date] = t->oldest_date;
-        newrow[list_store->columns.thread_id]   = t->thread_id;
-        newrow[list_store->columns.thread]      = Glib::RefPtr<NotmuchThread>(t);
+    LOG (debug) << "ql: updated " << (in_query.size () - added.size ()) << ", added " << added.size ()
+                << ", deleted " << deleted << " threads in: " << ((clock() - t0) * 1000.0 / CLOCKS_PER_SEC) << " ms.";
 
-        /* check if we should select it (if this is the only item) */
-        if (list_store->children().size() == 1) {
-          if (!in_destructor)
-            first_thread_ready.emit ();
-        } else {
+    if (!added.empty ()) {
+      /* check if we should select it (if this is the only item) */
+      if (was_empty) {
+        if (!in_destructor)
+          first_thread_ready.emit ();
 
-          if (path == Gtk::TreePath ("0")) {
-            Gtk::TreePath addpath = list_store->get_path (iter);
-            if (addpath <= path) {
-              list_view->set_cursor (addpath);
-            }
-          }
+      } else if (path == Gtk::TreePath ("0")) {
+        /* a new thread is above the cursor if it is now at the top */
+        Gtk::TreePath addpath ("0");
+        if (added.count (list_store->get_thread (list_store->get_iter (addpath)).operator-> ())) {
+          list_view->set_cursor (addpath);
         }
-
-        changed = true;
       }
     }
 
-    if (changed) {
+    if (!in_query.empty () || deleted > 0) {
       refresh_stats_db (db); // we should already be running on the gui thread
       list_view->thread_index->on_stats_ready ();
     }
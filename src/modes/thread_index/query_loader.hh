@@ -3,6 +3,10 @@
 # include <thread>
 # include <mutex>
 # include <queue>
+# include <deque>
+# include <atomic>
+# include <string>
+# include <unordered_map>
 # include <notmuch.h>
 
 # include "proto.hh"
@@ -30,14 +34,21 @@ namespace Astroid {
       refptr<ThreadIndexListStore> list_store;
       ThreadIndexListView * list_view;
 
-      notmuch_sort_t sort;
-      std::vector<ustring> sort_strings = { "oldest", "newest", "messageid", "unsorted" };
+      ThreadIndexListStore::SortOrder sort;
+      std::vector<ustring> sort_strings = { "oldest", "newest", "messageid", "unsorted", "messages", "author" };
+
+      /* the order threads are queried in, orders notmuch does not have are
+       * sorted by the list store */
+      notmuch_sort_t query_sort ();
 
       Glib::Dispatcher first_thread_ready;
       Glib::Dispatcher stats_ready;
 
       bool loading ();
 
+      /* all threads matching the query are in the list */
+      bool complete ();
+
     private:
       ustring query;
       void refresh_stats_db (Db *);
@@ -52,17 +63,44 @@ namespace Astroid {
       std::queue<refptr<NotmuchThread>> to_list_store;
       std::mutex to_list_m;
 
+      /* set when the gui has been woken up, and cleared when it takes the
+       * queue: the loader does not signal again until then */
+      std::atomic<bool> to_list_pending;
+
       void to_list_adder ();
       Glib::Dispatcher queue_has_data;
 
-      /* this is a list of threads that got a changed signal
-       * while loading */
+      /* threads taken from the queue are added to the list store in batches
+       * from an idle handler, the batch size is adapted so that a batch takes
+       * about BATCH_TIME on the gui thread. */
+      static const int BATCH_TIME = 8; // ms
+      static const unsigned int MIN_BATCH = 100;
+      static const unsigned int MAX_BATCH = 50000;
+
+      std::deque<refptr<NotmuchThread>> to_add;
+      unsigned int batch_size = 500;
+      sigc::connection add_batch_c;
+
+      void take_queue ();
+      bool add_batch ();
+
+      /* the revision of the db the threads are loaded from */
+      std::atomic<unsigned long> loader_revision { 0 };
+
+      /* the threads that got a changed signal while loading, with the
+       * revision of the db of the latest signal. the changes that the
+       * loaded threads already have are dropped, the rest are applied in
+       * one pass when the load is done. */
       Glib::Dispatcher deferred_threads_d;
       void update_deferred_changed_threads ();
-      std::queue<ustring> changed_threads;
+      std::unordered_map<std::string, unsigned long> changed_threads;
 
       /* signal handlers */
       void on_thread_changed (Db *, ustring);
+      void on_threads_updated (Db *, const std::vector<ustring> &); // updated or changed
+
+      /* update, add or remove the changed threads in one pass */
+      void on_threads_changed (Db *, const std::vector<ustring> &);
       void on_refreshed ();
   };
 }
@@ -115,20 +115,32 @@ namespace Astroid {
         });
 
     keys.register_key ("C-s", "thread_index.cycle_sort",
-        "Cycle through sort options: 'oldest', 'newest', 'messageid', 'unsorted'",
+        "Cycle through sort options: 'oldest', 'newest', 'messageid', 'unsorted', 'messages', 'author'",
         [&] (Key) {
-          if (queryloader.sort == NOTMUCH_SORT_UNSORTED) {
-            queryloader.sort = NOTMUCH_SORT_OLDEST_FIRST;
+          if (queryloader.sort == ThreadIndexListStore::SortAuthor) {
+            queryloader.sort = ThreadIndexListStore::SortOldest;
           } else {
             int s = static_cast<int> (queryloader.sort);
             s++;
-            queryloader.sort = static_cast<notmuch_sort_t> (s);
+            queryloader.sort = static_cast<ThreadIndexListStore::SortOrder> (s);
           }
 
           LOG (info) << "ti: sorting by: " << queryloader.sort_strings[static_cast<int>(queryloader.sort)];
 
           list_view->set_sort_type (queryloader.sort);
-          queryloader.reload ();
+
+          if (queryloader.complete () && ThreadIndexListStore::sortable (queryloader.sort)) {
+            /* all threads are loaded: sort them in memory */
+            list_store->resort ();
+
+            Gtk::TreePath path;
+            Gtk::TreeViewColumn *c;
+            list_view->get_cursor (path, c);
+            if (path) list_view->scroll_to_row (path);
+
+          } else {
+            queryloader.reload ();
+          }
           return true;
         });
 
@@ -136,7 +148,7 @@ namespace Astroid {
         "thread_index.page_up",
         "Page up",
         [&] (Key) {
-          if (list_view->filtered_store->children().size () == 0) return true;
+          if (list_store->size () == 0) return true;
 
           auto adj = scroll->scroll.get_vadjustment ();
           adj->set_value (adj->get_value() - adj->get_page_increment ());
@@ -163,7 +175,7 @@ namespace Astroid {
         "thread_index.page_down",
         "Page down",
         [&] (Key) {
-          if (list_view->filtered_store->children().size () == 0) return true;
+          if (list_store->size () == 0) return true;
 
           auto adj = scroll->scroll.get_vadjustment ();
           adj->set_value (adj->get_value() + adj->get_page_increment ());
@@ -178,8 +190,7 @@ namespace Astroid {
           int cx, cy;
           list_view->get_path_at_pos (0, list_view->get_height (), newpath, c, cx, cy);
           if (!newpath || newpath == path) {
-            auto it   = list_view->filtered_store->children().end ();
-            newpath   = list_view->filtered_store->get_path (--it);
+            newpath   = list_store->get_path (list_store->iter_at (list_store->size () - 1));
           }
           if (newpath)
             list_view->set_cursor (newpath);
@@ -211,15 +222,17 @@ namespace Astroid {
   ustring ThreadIndex::get_label () {
     ustring f = "";
     if (!list_view->filter_txt.empty ()) {
-      f = ustring::compose (" (%1: %2)", list_view->filter_txt, list_view->filtered_store->children ().size ());
+      f = ustring::compose (" (%1: %2)", list_view->filter_txt, list_store->size ());
     }
 
     if (name == "")
-      return ustring::compose ("%1 (%2/%3)%4%5", query_string, queryloader.unread_messages,
-          queryloader.total_messages, queryloader.loading() ? " (%)" : "", f);
+      return ustring::compose ("%1 (%2/%3)%4%5%6", query_string, queryloader.unread_messages,
+          queryloader.total_messages, queryloader.loading() ? " (%)" : "", f,
+          list_view->get_bulk_progress ());
     else
-      return ustring::compose ("%1 (%2/%3)%4%5", name,
-          queryloader.unread_messages, queryloader.total_messages, queryloader.loading() ? " (%)" : "", f);
+      return ustring::compose ("%1 (%2/%3)%4%5%6", name,
+          queryloader.unread_messages, queryloader.total_messages, queryloader.loading() ? " (%)" : "", f,
+          list_view->get_bulk_progress ());
   }
 
   void ThreadIndex::open_thread (refptr<NotmuchThread> thread, bool new_tab, bool new_window) {
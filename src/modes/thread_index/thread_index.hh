@@ -4,7 +4,6 @@
 
 # include <gtkmm.h>
 # include <gtkmm/box.h>
-# include <gtkmm/liststore.h>
 # include <gtkmm/scrolledwindow.h>
 
 # include "modes/paned_mode.hh"
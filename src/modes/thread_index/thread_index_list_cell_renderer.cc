@@ -101,24 +101,69 @@ namespace Astroid {
       height              = content_height + line_spacing;
     }
 
-    if (thread->unread) {
-      font_description.set_weight (Pango::WEIGHT_BOLD);
-    } else {
-      font_description.set_weight (Pango::WEIGHT_NORMAL);
+    bool selected = ((flags & Gtk::CELL_RENDERER_SELECTED) != 0);
+
+    if (tag_colors_version != Utils::tag_colors_version) {
+      invalidate_cache ();
+      tag_colors_version = Utils::tag_colors_version;
+    }
+
+    /* look up or build layouts */
+    auto key = std::make_pair (thread->thread_id.raw (), selected);
+    auto r   = row_cache.find (key);
+
+    if (r == row_cache.end () || r->second.version != thread->version) {
+      if (r == row_cache.end ()) {
+        if (row_cache.size () >= row_cache_size) row_cache.clear ();
+        r = row_cache.insert (std::make_pair (key, RowLayouts ())).first;
+      }
+
+      build_row (widget, r->second, selected);
+    }
+
+    RowLayouts &row = r->second;
+
+    time_t  expires;
+    ustring date = Date::pretty_print (thread->newest_date, expires);
+    date_expires = min (date_expires, expires);
+
+    if (date != row.date) {
+      if (thread->unread) {
+        font_description.set_weight (Pango::WEIGHT_BOLD);
+      } else {
+        font_description.set_weight (Pango::WEIGHT_NORMAL);
+      }
+
+      row.date        = date;
+      row.date_layout = make_date (widget, date);
     }
 
     render_background (cr, widget, background_area, flags);
-    render_date (cr, widget, cell_area); // returns height
+
+    /* set color */
+    Glib::RefPtr<Gtk::StyleContext> stylecontext = widget.get_style_context();
+    Gdk::RGBA color = stylecontext->get_color(Gtk::STATE_FLAG_NORMAL);
+    cr->set_source_rgb (color.get_red(), color.get_green(), color.get_blue());
+
+    render_layout (cr, row.date_layout, cell_area, date_start);
 
     if (thread->total_messages > 1)
-      render_message_count (cr, widget, cell_area);
+      render_layout (cr, row.message_count, cell_area, message_count_start);
+
+    render_layout (cr, row.authors, cell_area, authors_start);
+
+    if (selected) {
+      Gdk::Color bg (background_color_selected);
+      cr->set_source_rgb (bg.get_red_p(), bg.get_green_p(), bg.get_blue_p());
+    }
 
-    render_authors (cr, widget, cell_area);
+    render_layout (cr, row.tags, cell_area, tags_start);
 
-    tags_width = render_tags (cr, widget, cell_area, flags); // returns width
+    tags_width = row.tags_width;
     subject_start = tags_start + tags_width / Pango::SCALE + ((tags_width > 0) ? padding : 0);
 
-    render_subject (cr, widget, cell_area, flags);
+    cr->set_source_rgb (color.get_red(), color.get_green(), color.get_blue());
+    render_layout (cr, row.subject, cell_area, subject_start);
 
     /*
     if (!last)
@@ -142,6 +187,50 @@ namespace Astroid {
     LOG (debug) << "til cr: deconstruct.";
   }
 
+  void ThreadIndexListCellRenderer::invalidate_cache () {
+    row_cache.clear ();
+    tag_strings.clear ();
+  }
+
+  void ThreadIndexListCellRenderer::build_row (
+      Gtk::Widget &widget,
+      RowLayouts &row,
+      bool selected) {
+
+    if (thread->unread) {
+      font_description.set_weight (Pango::WEIGHT_BOLD);
+    } else {
+      font_description.set_weight (Pango::WEIGHT_NORMAL);
+    }
+
+    rows_built++;
+
+    row.version       = thread->version;
+    row.date          = ""; // date layout is made on render
+    row.message_count = make_message_count (widget);
+    row.authors       = make_authors (widget);
+    row.tags          = make_tags (widget, selected);
+    row.subject       = make_subject (widget, selected);
+
+    int h;
+    row.tags->get_size (row.tags_width, h);
+  }
+
+  void ThreadIndexListCellRenderer::render_layout (
+      const ::Cairo::RefPtr< ::Cairo::Context>&cr,
+      refptr<Pango::Layout> layout,
+      const Gdk::Rectangle &cell_area,
+      int x) {
+
+    /* align in the middle */
+    int w, h;
+    layout->get_size (w, h);
+    int y = max(0,(line_height / 2) - ((h / Pango::SCALE) / 2));
+
+    cr->move_to (cell_area.get_x() + x, cell_area.get_y() + y);
+    layout->show_in_cairo_context (cr);
+  }
+
   void ThreadIndexListCellRenderer::render_background ( // {{{
       const ::Cairo::RefPtr< ::Cairo::Context>&cr,
       Gtk::Widget & /* widget */,
@@ -281,23 +370,16 @@ namespace Astroid {
 
   } // }}}
 
-  void ThreadIndexListCellRenderer::render_subject ( // {{{
-      const ::Cairo::RefPtr< ::Cairo::Context>&cr,
+  refptr<Pango::Layout> ThreadIndexListCellRenderer::make_subject ( // {{{
       Gtk::Widget &widget,
-      const Gdk::Rectangle &cell_area,
-      Gtk::CellRendererState flags) {
+      bool selected) {
 
     Glib::RefPtr<Pango::Layout> pango_layout = widget.create_pango_layout ("");
 
     pango_layout->set_font_description (font_description);
 
-    /* set color */
-    Glib::RefPtr<Gtk::StyleContext> stylecontext = widget.get_style_context();
-
-    Gdk::RGBA color = stylecontext->get_color(Gtk::STATE_FLAG_NORMAL);
-    cr->set_source_rgb (color.get_red(), color.get_green(), color.get_blue());
     ustring color_str;
-    if ((flags & Gtk::CELL_RENDERER_SELECTED) != 0) {
+    if (selected) {
       color_str = subject_color_selected;
     } else {
       color_str = subject_color;
@@ -307,32 +389,18 @@ namespace Astroid {
         color_str,
         Glib::Markup::escape_text(thread->subject)));
 
-    /* align in the middle */
-    int w, h;
-    pango_layout->get_size (w, h);
-    int y = max(0,(line_height / 2) - ((h / Pango::SCALE) / 2));
-
-    cr->move_to (cell_area.get_x() + subject_start, cell_area.get_y() + y);
-    pango_layout->show_in_cairo_context (cr);
+    return pango_layout;
 
   } // }}}
 
-  int ThreadIndexListCellRenderer::render_tags ( // {{{
-      const ::Cairo::RefPtr< ::Cairo::Context>&cr,
+  refptr<Pango::Layout> ThreadIndexListCellRenderer::make_tags ( // {{{
       Gtk::Widget &widget,
-      const Gdk::Rectangle &cell_area,
-      Gtk::CellRendererState flags) {
+      bool selected) {
 
     Glib::RefPtr<Pango::Layout> pango_layout = widget.create_pango_layout ("");
 
     pango_layout->set_font_description (font_description);
 
-    /* set color */
-    Glib::RefPtr<Gtk::StyleContext> stylecontext = widget.get_style_context();
-
-    Gdk::RGBA color = stylecontext->get_color(Gtk::STATE_FLAG_NORMAL);
-    cr->set_source_rgb (color.get_red(), color.get_green(), color.get_blue());
-
     /* subtract hidden tags */
     vector<ustring> tags;
     set_difference (thread->tags.begin(),
@@ -341,80 +409,72 @@ namespace Astroid {
                     hidden_tags.end (),
                     back_inserter(tags));
 
-    ustring tag_string;
+    std::string key;
+    for (auto &t : tags) {
+      key += t.raw ();
+      key += '\n';
+    }
 
-    Gdk::Color bg;
+    auto ts = tag_strings.find (std::make_pair (key, selected));
 
-    if ((flags & Gtk::CELL_RENDERER_SELECTED) != 0) {
-      bg = Gdk::Color (background_color_selected);
-      cr->set_source_rgb (bg.get_red_p(), bg.get_green_p(), bg.get_blue_p());
-    } else {
-      bg.set_grey_p (1.);
-    }
+    if (ts == tag_strings.end ()) {
+      ustring tag_string;
 
-    /* first try plugin */
-# ifndef DISABLE_PLUGINS
-    if (!thread_index->plugins->format_tags (tags, bg.to_string (), (flags & Gtk::CELL_RENDERER_SELECTED) != 0, tag_string)) {
-# endif
+      Gdk::Color bg;
 
-      unsigned char cv[3] = { (unsigned char) bg.get_red (),
-                              (unsigned char) bg.get_green (),
-                              (unsigned char) bg.get_blue () };
+      if (selected) {
+        bg = Gdk::Color (background_color_selected);
+      } else {
+        bg.set_grey_p (1.);
+      }
 
-      tag_string = VectorUtils::concat_tags_color (tags, true, tags_len, cv);
-# ifndef DISABLE_PLUGINS
+      /* first try plugin */
+      if (!plugin_format_tags (tags, bg.to_string (), selected, tag_string)) {
+        unsigned char cv[3] = { (unsigned char) bg.get_red (),
+                                (unsigned char) bg.get_green (),
+                                (unsigned char) bg.get_blue () };
+
+        tag_string = VectorUtils::concat_tags_color (tags, true, tags_len, cv);
+      }
+
+      ts = tag_strings.insert (std::make_pair (std::make_pair (key, selected), tag_string)).first;
     }
-# endif
+
+    const ustring &tag_string = ts->second;
 
     pango_layout->set_markup (tag_string);
 
-    /* align in the middle */
-    int w, h;
-    pango_layout->get_size (w, h);
-    int y = max(0,(line_height / 2) - ((h / Pango::SCALE) / 2));
+    return pango_layout;
 
-    cr->move_to (cell_area.get_x() + tags_start, cell_area.get_y() + y);
-    pango_layout->show_in_cairo_context (cr);
+  } // }}}
 
-    return w;
+  bool ThreadIndexListCellRenderer::plugin_format_tags (
+      std::vector<ustring> tags,
+      ustring bg,
+      bool selected,
+      ustring &out) {
 
-  } // }}}
+# ifndef DISABLE_PLUGINS
+    return thread_index->plugins->format_tags (tags, bg, selected, out);
+# else
+    return false;
+# endif
+  }
 
-  int ThreadIndexListCellRenderer::render_date ( // {{{
-      const ::Cairo::RefPtr< ::Cairo::Context>&cr,
+  refptr<Pango::Layout> ThreadIndexListCellRenderer::make_date ( // {{{
       Gtk::Widget &widget,
-      const Gdk::Rectangle &cell_area ) {
-
-    ustring date = Date::pretty_print (thread->newest_date);
+      ustring date) {
 
     Glib::RefPtr<Pango::Layout> pango_layout = widget.create_pango_layout (date);
 
     pango_layout->set_font_description (font_description);
 
-    /* set color */
-    Glib::RefPtr<Gtk::StyleContext> stylecontext = widget.get_style_context();
-    Gdk::RGBA color = stylecontext->get_color(Gtk::STATE_FLAG_NORMAL);
-    cr->set_source_rgb (color.get_red(), color.get_green(), color.get_blue());
-
-    /* align in the middle */
-    int w, h;
-    pango_layout->get_size (w, h);
-    int y = max(0,(line_height / 2) - ((h / Pango::SCALE) / 2));
-
-    /* update subject start */
-    //subject_start = date_start + (w / Pango::SCALE) + padding;
-
-    cr->move_to (cell_area.get_x() + date_start, cell_area.get_y() + y);
-    pango_layout->show_in_cairo_context (cr);
-
-    return h; // return height!
+    return pango_layout;
 
   } // }}}
 
-  void ThreadIndexListCellRenderer::render_message_count ( // {{{
-      const ::Cairo::RefPtr< ::Cairo::Context>&cr,
-      Gtk::Widget &widget,
-      const Gdk::Rectangle &cell_area ) {
+  refptr<Pango::Layout> ThreadIndexListCellRenderer::make_message_count ( // {{{
+      Gtk::Widget &widget) {
 
 # define BUFLEN 24
     char buf[BUFLEN];
@@ -425,28 +485,12 @@ namespace Astroid {
 
     pango_layout->set_font_description (font_description);
 
-    /* set color */
-    Glib::RefPtr<Gtk::StyleContext> stylecontext = widget.get_style_context();
-    Gdk::RGBA color = stylecontext->get_color(Gtk::STATE_FLAG_NORMAL);
-    cr->set_source_rgb (color.get_red(), color.get_green(), color.get_blue());
-
-    /* align in the middle */
-    int w, h;
-    pango_layout->get_size (w, h);
-    int y = max(0,(line_height / 2) - ((h / Pango::SCALE) / 2));
-
-    /* update subject start */
-    //subject_start = date_start + (w / Pango::SCALE) + padding;
-
-    cr->move_to (cell_area.get_x() + message_count_start, cell_area.get_y() + y);
-    pango_layout->show_in_cairo_context (cr);
+    return pango_layout;
 
   } // }}}
 
-  void ThreadIndexListCellRenderer::render_authors ( // {{{
-      const ::Cairo::RefPtr< ::Cairo::Context>&cr,
-      Gtk::Widget &widget,
-      const Gdk::Rectangle &cell_area ) {
+  refptr<Pango::Layout> ThreadIndexListCellRenderer::make_authors ( // {{{
+      Gtk::Widget &widget) {
 
     /* format authors string */
     ustring authors;
@@ -523,21 +567,7 @@ namespace Astroid {
       font_description.set_weight (Pango::WEIGHT_BOLD);
     }
 
-    /* set color */
-    Glib::RefPtr<Gtk::StyleContext> stylecontext = widget.get_style_context();
-    Gdk::RGBA color = stylecontext->get_color(Gtk::STATE_FLAG_NORMAL);
-    cr->set_source_rgb (color.get_red(), color.get_green(), color.get_blue());
-
-    /* align in the middle */
-    int w, h;
-    pango_layout->get_size (w, h);
-    int y = max(0,(line_height / 2) - ((h / Pango::SCALE) / 2));
-
-    /* update subject start */
-    //subject_start = date_start + (w / Pango::SCALE) + padding;
-
-    cr->move_to (cell_area.get_x() + authors_start, cell_area.get_y() + y);
-    pango_layout->show_in_cairo_context (cr);
+    return pango_layout;
 
   } // }}}
 
@@ -1,6 +1,8 @@
 # pragma once
 
 # include <vector>
+# include <map>
+# include <limits>
 
 # include <gtkmm.h>
 # include <gtkmm/cellrenderer.h>
@@ -26,6 +28,16 @@ namespace Astroid {
 
       int get_height ();
 
+      /* drop all pre-built rows, e.g. when the font or theme changes */
+      void invalidate_cache ();
+
+      /* rows built since the renderer was created, the rest were drawn
+       * from the cache */
+      unsigned long rows_built = 0;
+
+      /* the earliest time a date drawn since the last reset goes stale */
+      time_t date_expires = std::numeric_limits<time_t>::max ();
+
     protected:
       /* best documentation so far from here:
        * https://git.gnome.org/browse/gtkmm/tree/gtk/src/cellrenderer.hg
@@ -46,6 +58,13 @@ namespace Astroid {
 
       int calculate_height (Gtk::Widget &) const;
 
+      /* the tag string made by the thread index plugins, if any */
+      virtual bool plugin_format_tags (
+          std::vector<ustring> tags,
+          ustring bg,
+          bool selected,
+          ustring &out);
+
       virtual void get_preferred_height_vfunc (
           Gtk::Widget& widget,
           int& minimum_height,
@@ -112,32 +131,48 @@ namespace Astroid {
           const Gdk::Rectangle &background_area,
           Gtk::CellRendererState flags);
 
-      void render_subject (
-          const ::Cairo::RefPtr< ::Cairo::Context>&cr,
-          Gtk::Widget &widget,
-          const Gdk::Rectangle &cell_area,
-          Gtk::CellRendererState flags);
+    protected:
+      /* the layouts of a row only depend on the thread and whether the row
+       * is selected, they are built once and re-used until the thread
+       * changes (NotmuchThread::version). */
+      struct RowLayouts {
+        unsigned long version;
+
+        ustring date; // the relative date changes with time
+        refptr<Pango::Layout> date_layout;
+        refptr<Pango::Layout> message_count;
+        refptr<Pango::Layout> authors;
+        refptr<Pango::Layout> tags;
+        refptr<Pango::Layout> subject;
+
+        int tags_width;
+      };
+
+      /* keyed by thread id and selection, cleared when it grows beyond
+       * row_cache_size. */
+      std::map<std::pair<std::string, bool>, RowLayouts> row_cache;
+      const unsigned int row_cache_size = 2000;
 
-      int render_tags (
-          const ::Cairo::RefPtr< ::Cairo::Context>&cr,
-          Gtk::Widget &widget,
-          const Gdk::Rectangle &cell_area,
-          Gtk::CellRendererState flags );
+    private:
+      void build_row (Gtk::Widget &widget, RowLayouts &row, bool selected);
 
-      int render_date (
-          const ::Cairo::RefPtr< ::Cairo::Context>&cr,
-          Gtk::Widget &widget,
-          const Gdk::Rectangle &cell_area );
+      /* formatted tag strings, keyed by the visible tags (joined) and
+       * selection. rows and tag strings are dropped when the tag colors
+       * change (Utils::tag_colors_version). */
+      std::map<std::pair<std::string, bool>, ustring> tag_strings;
+      unsigned long tag_colors_version = 0;
 
-      void render_message_count (
+      void render_layout (
           const ::Cairo::RefPtr< ::Cairo::Context>&cr,
-          Gtk::Widget &widget,
-          const Gdk::Rectangle &cell_area );
+          refptr<Pango::Layout> layout,
+          const Gdk::Rectangle &cell_area,
+          int x);
 
-      void render_authors (
-          const ::Cairo::RefPtr< ::Cairo::Context>&cr,
-          Gtk::Widget &widget,
-          const Gdk::Rectangle &cell_area );
+      refptr<Pango::Layout> make_subject (Gtk::Widget &widget, bool selected);
+      refptr<Pango::Layout> make_tags (Gtk::Widget &widget, bool selected);
+      refptr<Pango::Layout> make_date (Gtk::Widget &widget, ustring date);
+      refptr<Pango::Layout> make_message_count (Gtk::Widget &widget);
+      refptr<Pango::Layout> make_authors (Gtk::Widget &widget);
 
       void render_delimiter (
           const ::Cairo::RefPtr< ::Cairo::Context>&cr,
@@ -0,0 +1,675 @@
+# include <algorithm>
+# include <numeric>
+# include <thread>
+# include <chrono>
+
+# include "astroid.hh"
+# include "db.hh"
+# include "thread_index_list_store.hh"
+
+namespace Astroid {
+  namespace {
+    template <class T> void set_column_value (
+        Glib::ValueBase & value,
+        const Gtk::TreeModelColumn<T> & column,
+        const T & data)
+    {
+      Glib::Value<T> v;
+      v.init (column.type ());
+      v.set (data);
+
+      value.init (v.gobj ());
+    }
+
+    /* stable sort, split over the available cores for long ranges */
+    template <class It, class Cmp> void parallel_sort (It begin, It end, Cmp cmp, size_t min_size) {
+      size_t n = end - begin;
+      size_t k = std::min (std::thread::hardware_concurrency (), 8u);
+
+      if (n < min_size || k < 2) {
+        std::stable_sort (begin, end, cmp);
+        return;
+      }
+
+      std::vector<It> bounds;
+      for (size_t i = 0; i <= k; i++) bounds.push_back (begin + (n * i / k));
+
+      std::vector<std::thread> workers;
+      for (size_t i = 0; i < k; i++) {
+        workers.push_back (std::thread ([&, i] {
+              std::stable_sort (bounds[i], bounds[i+1], cmp);
+            }));
+      }
+
+      for (auto & w : workers) w.join ();
+
+      for (size_t w = 1; w < k; w *= 2) {
+        for (size_t i = 0; i + w < k; i += 2 * w) {
+          std::inplace_merge (bounds[i], bounds[i + w], bounds[std::min (i + 2 * w, k)], cmp);
+        }
+      }
+    }
+  }
+
+  ThreadIndexListStore::ThreadIndexListStoreColumnRecord::ThreadIndexListStoreColumnRecord () {
+    add (newest_date);
+    add (oldest_date);
+    add (thread_id);
+    add (thread);
+    add (marked);
+  }
+
+  ThreadIndexListStore::ThreadIndexListStore () :
+    Glib::ObjectBase (typeid (ThreadIndexListStore)),
+    Glib::Object ()
+  {
+    stamp = g_random_int ();
+    if (stamp == 0) stamp = 1;
+  }
+
+  ThreadIndexListStore::~ThreadIndexListStore () {
+    LOG (debug) << "tils: deconstuct.";
+  }
+
+  /* rows */
+  unsigned int ThreadIndexListStore::size () const {
+    return visible_size ();
+  }
+
+  unsigned int ThreadIndexListStore::total_size () const {
+    return rows.size ();
+  }
+
+  unsigned int ThreadIndexListStore::visible_size () const {
+    if (refiltering) {
+      return refilter_head.size () + (visible.size () - refilter_tail);
+    } else {
+      return visible.size ();
+    }
+  }
+
+  unsigned int ThreadIndexListStore::visible_row (unsigned int p) const {
+    if (refiltering) {
+      if (p < refilter_head.size ()) return refilter_head[p];
+      else return visible[refilter_tail + (p - refilter_head.size ())];
+    } else {
+      return visible[p];
+    }
+  }
+
+  bool ThreadIndexListStore::is_visible (const refptr<NotmuchThread> & t) {
+    return visible_func.empty () || visible_func (t);
+  }
+
+  Gtk::TreeModel::iterator ThreadIndexListStore::iter_at (unsigned int p) {
+    if (p >= visible_size ()) return iterator ();
+
+    return get_iter (make_path (p));
+  }
+
+  unsigned int ThreadIndexListStore::get_position (const iterator & iter) const {
+    return GPOINTER_TO_UINT (iter.gobj ()->user_data);
+  }
+
+  refptr<NotmuchThread> ThreadIndexListStore::get_thread (const iterator & iter) const {
+    if (!valid (iter)) return refptr<NotmuchThread> ();
+
+    return rows[visible_row (get_position (iter))].thread;
+  }
+
+  bool ThreadIndexListStore::get_marked (const iterator & iter) const {
+    if (marked.empty () || !valid (iter)) return false;
+
+    return marked.count (rows[visible_row (get_position (iter))].thread.operator-> ()) > 0;
+  }
+
+  void ThreadIndexListStore::set_marked (const iterator & iter, bool m) {
+    if (!valid (iter)) return;
+
+    unsigned int p = get_position (iter);
+    const refptr<NotmuchThread> & t = rows[visible_row (p)].thread;
+
+    bool changed;
+
+    if (m) {
+      changed = marked.insert (std::make_pair (t.operator-> (), t)).second;
+    } else {
+      changed = marked.erase (t.operator-> ()) > 0;
+    }
+
+    if (changed) row_changed (make_path (p), iter);
+  }
+
+  unsigned int ThreadIndexListStore::marked_count () const {
+    return marked.size ();
+  }
+
+  std::vector<refptr<NotmuchThread>> ThreadIndexListStore::get_marked_threads () {
+    std::vector<refptr<NotmuchThread>> threads;
+    threads.reserve (marked.size ());
+
+    for (auto & m : marked) {
+      if (is_visible (m.second)) threads.push_back (m.second);
+    }
+
+    return threads;
+  }
+
+  void ThreadIndexListStore::toggle_marked_all () {
+    for (unsigned int p = 0; p < visible.size (); p++) {
+      const refptr<NotmuchThread> & t = rows[visible[p]].thread;
+
+      if (!marked.erase (t.operator-> ())) {
+        marked.insert (std::make_pair (t.operator-> (), t));
+      }
+    }
+  }
+
+  void ThreadIndexListStore::unmark_all () {
+    marked.clear ();
+  }
+
+  bool ThreadIndexListStore::sortable (SortOrder s) {
+    return (s != SortMessageId && s != SortUnsorted);
+  }
+
+  void ThreadIndexListStore::set_sort (SortOrder s) {
+    sort = s;
+    sort_keys.clear ();
+  }
+
+  void ThreadIndexListStore::set_sort_key_func (const SlotSortKey & f) {
+    sort_key_func = f;
+  }
+
+  bool ThreadIndexListStore::ordered () const {
+    return sortable (sort) || (sort == SortMessageId && sort_key_func);
+  }
+
+  const std::string & ThreadIndexListStore::sort_key (const NotmuchThread * t) const {
+    auto k = sort_keys.find (t);
+
+    if (k == sort_keys.end ()) {
+      k = sort_keys.insert (std::make_pair (t, sort_key_func (t))).first;
+    }
+
+    return k->second;
+  }
+
+  std::string ThreadIndexListStore::author_key (const NotmuchThread * t) {
+    if (t->authors.empty ()) return "";
+
+    return std::get<0> (t->authors[0]).lowercase ().raw ();
+  }
+
+  ThreadIndexListStore::Row ThreadIndexListStore::make_row (const refptr<NotmuchThread> & t) {
+    return Row { t, author_key (t.operator-> ()) };
+  }
+
+  bool ThreadIndexListStore::sorted_before (const Row & ra, const Row & rb) const {
+    const NotmuchThread * a = ra.thread.operator-> ();
+    const NotmuchThread * b = rb.thread.operator-> ();
+
+    switch (sort) {
+      case SortNewest:
+        return a->newest_date > b->newest_date;
+
+      case SortOldest:
+        return a->oldest_date < b->oldest_date;
+
+      case SortMessages:
+        if (a->total_messages != b->total_messages)
+          return a->total_messages > b->total_messages;
+        return a->newest_date > b->newest_date;
+
+      case SortAuthor:
+        if (ra.author != rb.author) return ra.author < rb.author;
+        return a->newest_date > b->newest_date;
+
+      case SortMessageId:
+        if (!sort_key_func) return false;
+        return sort_key (a) < sort_key (b);
+
+      default:
+        return false;
+    }
+  }
+
+  void ThreadIndexListStore::resort () {
+    if (!sortable (sort) || rows.size () < 2) return;
+
+    auto t0 = std::chrono::steady_clock::now ();
+
+    /* sort the row indices */
+    std::vector<unsigned int> order (rows.size ());
+    std::iota (order.begin (), order.end (), 0);
+
+    parallel_sort (order.begin (), order.end (),
+        [&] (unsigned int a, unsigned int b) {
+          return sorted_before (rows[a], rows[b]);
+        }, PARALLEL_SORT_MIN);
+
+    reorder (order);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - t0;
+    LOG (debug) << "tils: sorted " << rows.size () << " rows in " << (elapsed.count () * 1000.) << " ms.";
+  }
+
+  void ThreadIndexListStore::reorder (const std::vector<unsigned int> & order) {
+    /* old visible position of each row */
+    std::vector<int> position (rows.size (), -1);
+    for (unsigned int p = 0; p < visible.size (); p++) position[visible[p]] = p;
+
+    std::vector<Row> sorted_rows;
+    sorted_rows.reserve (rows.size ());
+
+    std::vector<unsigned int> sorted_visible;
+    sorted_visible.reserve (visible.size ());
+
+    std::vector<int> new_order; // new position -> old position
+    new_order.reserve (visible.size ());
+
+    for (unsigned int r = 0; r < order.size (); r++) {
+      sorted_rows.push_back (std::move (rows[order[r]]));
+
+      if (position[order[r]] >= 0) {
+        sorted_visible.push_back (r);
+        new_order.push_back (position[order[r]]);
+      }
+    }
+
+    rows.swap (sorted_rows);
+    visible.swap (sorted_visible);
+
+    invalidate_iters ();
+
+    if (!new_order.empty ()) {
+      Path root;
+      gtk_tree_model_rows_reordered (Gtk::TreeModel::gobj (), root.gobj (), NULL, new_order.data ());
+    }
+  }
+
+  unsigned int ThreadIndexListStore::insert_row (const refptr<NotmuchThread> & t, bool front) {
+    Row row = make_row (t);
+    unsigned int r;
+
+    if (!ordered ()) {
+      r = front ? 0 : rows.size ();
+
+    } else if (!front && (rows.empty () || !sorted_before (row, rows.back ()))) {
+      /* after the last row */
+      r = rows.size ();
+
+    } else if (front) {
+      r = std::lower_bound (rows.begin (), rows.end (), row,
+          [&] (const Row & a, const Row & b) {
+            return sorted_before (a, b);
+          }) - rows.begin ();
+
+    } else {
+      r = std::upper_bound (rows.begin (), rows.end (), row,
+          [&] (const Row & a, const Row & b) {
+            return sorted_before (a, b);
+          }) - rows.begin ();
+    }
+
+    rows.insert (rows.begin () + r, std::move (row));
+
+    /* shift the visible rows after the new one */
+    for (auto v = std::lower_bound (visible.begin (), visible.end (), r);
+        v != visible.end (); v++) {
+      (*v)++;
+    }
+
+    return r;
+  }
+
+  void ThreadIndexListStore::show_row (unsigned int r) {
+    if (!is_visible (rows[r].thread)) return;
+
+    auto v = std::lower_bound (visible.begin (), visible.end (), r);
+    unsigned int p = v - visible.begin ();
+    visible.insert (v, r);
+
+    invalidate_iters ();
+
+    Path path = make_path (p);
+    row_inserted (path, get_iter (path));
+  }
+
+  void ThreadIndexListStore::remove_row (unsigned int r) {
+    auto v = std::lower_bound (visible.begin (), visible.end (), r);
+    unsigned int p = v - visible.begin ();
+
+    bool was = (v != visible.end () && *v == r);
+    if (was) v = visible.erase (v);
+
+    for (; v != visible.end (); v++) (*v)--;
+
+    rows.erase (rows.begin () + r);
+
+    if (was) {
+      invalidate_iters ();
+      row_deleted (make_path (p));
+    }
+  }
+
+  int ThreadIndexListStore::find_row (const NotmuchThread * t) const {
+    for (unsigned int r = 0; r < rows.size (); r++) {
+      if (rows[r].thread.operator-> () == t) return r;
+    }
+
+    return -1;
+  }
+
+  void ThreadIndexListStore::append (const std::vector<refptr<NotmuchThread>> & threads) {
+    rows.reserve (rows.size () + threads.size ());
+
+    /* threads are usually loaded in the order of the store, otherwise they
+     * are appended, and the new rows are sorted and merged into the loaded
+     * ones. */
+    unsigned int loaded = rows.size ();
+    bool in_order = true;
+
+    for (auto & t : threads) {
+      Row row = make_row (t);
+
+      if (in_order && sortable (sort) && !rows.empty () &&
+          sorted_before (row, rows.back ())) {
+        in_order = false;
+      }
+
+      rows.push_back (std::move (row));
+      show_row (rows.size () - 1);
+    }
+
+    if (!in_order) {
+      std::vector<unsigned int> order (rows.size ());
+      std::iota (order.begin (), order.end (), 0);
+
+      auto cmp = [&] (unsigned int a, unsigned int b) {
+        return sorted_before (rows[a], rows[b]);
+      };
+
+      std::stable_sort (order.begin () + loaded, order.end (), cmp);
+      std::inplace_merge (order.begin (), order.begin () + loaded, order.end (), cmp);
+
+      reorder (order);
+    }
+  }
+
+  void ThreadIndexListStore::insert (refptr<NotmuchThread> t) {
+    show_row (insert_row (t, true));
+  }
+
+  void ThreadIndexListStore::for_each_thread (std::function<void (const refptr<NotmuchThread> &)> f) const {
+    for (auto & r : rows) f (r.thread);
+  }
+
+  refptr<NotmuchThread> ThreadIndexListStore::find (const ustring & thread_id) const {
+    for (auto & r : rows) {
+      if (r.thread->thread_id.raw () == thread_id.raw ()) return r.thread;
+    }
+
+    return refptr<NotmuchThread> ();
+  }
+
+  void ThreadIndexListStore::update (refptr<NotmuchThread> t) {
+    int r = find_row (t.operator-> ());
+    if (r < 0) return;
+
+    /* the messages of the thread may have changed */
+    sort_keys.erase (t.operator-> ());
+    rows[r].author = author_key (t.operator-> ());
+
+    auto v = std::lower_bound (visible.begin (), visible.end (), (unsigned int) r);
+    unsigned int p = v - visible.begin ();
+    bool was = (v != visible.end () && *v == (unsigned int) r);
+    bool now = is_visible (t);
+
+    if (was && !now) {
+      visible.erase (v);
+      invalidate_iters ();
+      row_deleted (make_path (p));
+      was = false;
+    }
+
+    bool in_order =
+      (r == 0 || !sorted_before (rows[r], rows[r-1])) &&
+      ((unsigned int) r + 1 == rows.size () || !sorted_before (rows[r+1], rows[r]));
+
+    if (!in_order) {
+      /* move the row to its sorted position */
+
+      v = std::lower_bound (visible.begin (), visible.end (), (unsigned int) r);
+      if (was) v = visible.erase (v);
+      for (; v != visible.end (); v++) (*v)--;
+      rows.erase (rows.begin () + r);
+
+      r = insert_row (t, false);
+
+      if (was) {
+        v = std::lower_bound (visible.begin (), visible.end (), (unsigned int) r);
+        unsigned int np = v - visible.begin ();
+        visible.insert (v, r);
+
+        invalidate_iters ();
+
+        if (np != p) {
+          /* new_order[new position] = old position */
+          std::vector<int> new_order (visible.size ());
+          for (unsigned int i = 0; i < new_order.size (); i++) {
+            if (i == np)                   new_order[i] = p;
+            else if (p < np && i >= p && i < np) new_order[i] = i + 1;
+            else if (np < p && i > np && i <= p) new_order[i] = i - 1;
+            else                           new_order[i] = i;
+          }
+
+          Path root;
+          gtk_tree_model_rows_reordered (Gtk::TreeModel::gobj (), root.gobj (), NULL, new_order.data ());
+        }
+
+        p = np;
+      }
+    }
+
+    if (was) {
+      Path path = make_path (p);
+      row_changed (path, get_iter (path));
+
+    } else if (now) {
+      show_row (r);
+    }
+  }
+
+  void ThreadIndexListStore::erase (refptr<NotmuchThread> t) {
+    int r = find_row (t.operator-> ());
+    if (r >= 0) remove_row (r);
+
+    marked.erase (t.operator-> ());
+    sort_keys.erase (t.operator-> ());
+  }
+
+  void ThreadIndexListStore::clear () {
+    /* delete from the end so that no rows need to move in the view */
+    while (!visible.empty ()) {
+      visible.pop_back ();
+      invalidate_iters ();
+      row_deleted (make_path (visible.size ()));
+    }
+
+    rows.clear ();
+    marked.clear ();
+    sort_keys.clear ();
+  }
+
+  /* filtering */
+  void ThreadIndexListStore::set_visible_func (const SlotVisible & f) {
+    visible_func = f;
+  }
+
+  void ThreadIndexListStore::refilter () {
+    /* walk all rows once, only rows that changed visibility are signalled.
+     * the model stays consistent for the view while signalling: rows before
+     * the current one are in refilter_head, rows after in visible. */
+    refiltering = true;
+    refilter_tail = 0;
+    refilter_head.clear ();
+    refilter_head.reserve (visible.size ());
+
+    for (unsigned int r = 0; r < rows.size (); r++) {
+      bool was = (refilter_tail < visible.size () && visible[refilter_tail] == r);
+      bool now = is_visible (rows[r].thread);
+
+      if (was) refilter_tail++;
+      if (now) refilter_head.push_back (r);
+
+      if (was && !now) {
+        invalidate_iters ();
+        row_deleted (make_path (refilter_head.size ()));
+
+      } else if (!was && now) {
+        invalidate_iters ();
+        Path path = make_path (refilter_head.size () - 1);
+        row_inserted (path, get_iter (path));
+      }
+    }
+
+    visible.swap (refilter_head);
+    refilter_head.clear ();
+    refiltering = false;
+  }
+
+  /* iterators */
+  void ThreadIndexListStore::invalidate_iters () {
+    stamp++;
+    if (stamp == 0) stamp++;
+  }
+
+  bool ThreadIndexListStore::valid (const iterator & iter) const {
+    return iter.get_stamp () == stamp && get_position (iter) < visible_size ();
+  }
+
+  void ThreadIndexListStore::make_iter (unsigned int p, iterator & iter) const {
+    iter.set_stamp (stamp);
+    iter.gobj ()->user_data = GUINT_TO_POINTER (p);
+  }
+
+  Gtk::TreeModel::Path ThreadIndexListStore::make_path (unsigned int p) {
+    Path path;
+    path.push_back (p);
+    return path;
+  }
+
+  /* Gtk::TreeModel */
+  Gtk::TreeModelFlags ThreadIndexListStore::get_flags_vfunc () const {
+    return Gtk::TREE_MODEL_LIST_ONLY;
+  }
+
+  int ThreadIndexListStore::get_n_columns_vfunc () const {
+    return columns.size ();
+  }
+
+  GType ThreadIndexListStore::get_column_type_vfunc (int index) const {
+    if (index < 0 || index >= (int) columns.size ()) return G_TYPE_INVALID;
+
+    return columns.types ()[index];
+  }
+
+  void ThreadIndexListStore::get_value_vfunc (const iterator & iter, int column, Glib::ValueBase & value) const {
+    if (!valid (iter)) return;
+
+    const Row & row = rows[visible_row (get_position (iter))];
+
+    if (column == columns.newest_date.index ()) {
+      set_column_value (value, columns.newest_date, row.thread->newest_date);
+    } else if (column == columns.oldest_date.index ()) {
+      set_column_value (value, columns.oldest_date, row.thread->oldest_date);
+    } else if (column == columns.thread_id.index ()) {
+      set_column_value (value, columns.thread_id, row.thread->thread_id);
+    } else if (column == columns.thread.index ()) {
+      set_column_value (value, columns.thread, row.thread);
+    } else if (column == columns.marked.index ()) {
+      set_column_value (value, columns.marked, (bool) marked.count (row.thread.operator-> ()));
+    }
+  }
+
+  void ThreadIndexListStore::set_value_impl (const iterator & iter, int column, const Glib::ValueBase & value) {
+    /* only the marked column is writable */
+    if (column == columns.marked.index ()) {
+      Glib::Value<bool> v;
+      v.init (value.gobj ());
+      set_marked (iter, v.get ());
+    } else {
+      LOG (error) << "tils: column is not writable: " << column;
+    }
+  }
+
+  bool ThreadIndexListStore::iter_next_vfunc (const iterator & iter, iterator & iter_next) const {
+    if (valid (iter)) {
+      unsigned int p = get_position (iter) + 1;
+
+      if (p < visible_size ()) {
+        make_iter (p, iter_next);
+        return true;
+      }
+    }
+
+    iter_next = iterator ();
+    return false;
+  }
+
+  bool ThreadIndexListStore::iter_children_vfunc (const iterator &, iterator & iter) const {
+    iter = iterator ();
+    return false;
+  }
+
+  bool ThreadIndexListStore::iter_has_child_vfunc (const iterator &) const {
+    return false;
+  }
+
+  int ThreadIndexListStore::iter_n_children_vfunc (const iterator &) const {
+    return 0;
+  }
+
+  int ThreadIndexListStore::iter_n_root_children_vfunc () const {
+    return visible_size ();
+  }
+
+  bool ThreadIndexListStore::iter_nth_child_vfunc (const iterator &, int, iterator & iter) const {
+    iter = iterator ();
+    return false;
+  }
+
+  bool ThreadIndexListStore::iter_nth_root_child_vfunc (int n, iterator & iter) const {
+    if (n >= 0 && (unsigned int) n < visible_size ()) {
+      make_iter (n, iter);
+      return true;
+    }
+
+    iter = iterator ();
+    return false;
+  }
+
+  bool ThreadIndexListStore::iter_parent_vfunc (const iterator &, iterator & iter) const {
+    iter = iterator ();
+    return false;
+  }
+
+  Gtk::TreeModel::Path ThreadIndexListStore::get_path_vfunc (const iterator & iter) const {
+    if (!valid (iter)) return Path ();
+
+    return make_path (get_position (iter));
+  }
+
+  bool ThreadIndexListStore::get_iter_vfunc (const Path & path, iterator & iter) const {
+    if (path.size () == 1 && path[0] >= 0 && (unsigned int) path[0] < visible_size ()) {
+      make_iter (path[0], iter);
+      return true;
+    }
+
+    iter = iterator ();
+    return false;
+  }
+}
+
@@ -0,0 +1,210 @@
+# pragma once
+
+# include <vector>
+# include <functional>
+# include <unordered_map>
+
+# include <gtkmm.h>
+# include <gtkmm/treemodel.h>
+
+# include "proto.hh"
+
+# include "notmuch.h"
+
+namespace Astroid {
+  /* ----------
+   * list store
+   * ----------
+   *
+   * a flat tree model backed by a vector of threads. the rows that pass the
+   * visible function are kept in a vector of indices into the thread
+   * vector, the model exposes only the visible rows so that the view can be
+   * connected directly (no Gtk::TreeModelFilter). an iterator holds the
+   * position of the row among the visible rows, so mapping between paths
+   * and iterators is O(1). iterators are invalidated whenever rows are
+   * added, removed or moved.
+   *
+   * the rows are kept in the sort order of the store: threads are inserted
+   * at their sorted position, and loaded rows can be re-sorted in memory.
+   */
+  class ThreadIndexListStore : public Glib::Object, public Gtk::TreeModel {
+    public:
+      class ThreadIndexListStoreColumnRecord : public Gtk::TreeModel::ColumnRecord
+      {
+        public:
+          Gtk::TreeModelColumn<time_t> newest_date;
+          Gtk::TreeModelColumn<time_t> oldest_date;
+          Gtk::TreeModelColumn<Glib::ustring> thread_id;
+          Gtk::TreeModelColumn<Glib::RefPtr<NotmuchThread>> thread;
+          Gtk::TreeModelColumn<bool> marked;
+
+          ThreadIndexListStoreColumnRecord ();
+      };
+
+      ThreadIndexListStore ();
+      ~ThreadIndexListStore ();
+      const ThreadIndexListStoreColumnRecord columns;
+
+      typedef sigc::slot<bool, const refptr<NotmuchThread> &> SlotVisible;
+
+      /* the message id order can not be told from the loaded threads, the
+       * key of a thread is looked up with this when it is inserted */
+      typedef std::function<std::string (const NotmuchThread *)> SlotSortKey;
+
+      /* the first orders are the notmuch sort orders, the others are only
+       * done in memory. */
+      enum SortOrder {
+        SortOldest    = NOTMUCH_SORT_OLDEST_FIRST,
+        SortNewest    = NOTMUCH_SORT_NEWEST_FIRST,
+        SortMessageId = NOTMUCH_SORT_MESSAGE_ID,
+        SortUnsorted  = NOTMUCH_SORT_UNSORTED,
+        SortMessages,  // most messages first
+        SortAuthor,    // by first author
+      };
+
+      /* whether rows can be sorted in this order without the query */
+      static bool sortable (SortOrder);
+
+      /* visible (filtered) rows */
+      unsigned int size () const;
+
+      /* all loaded rows */
+      unsigned int total_size () const;
+
+      /* the visible row at position, or an invalid iterator */
+      iterator iter_at (unsigned int);
+      unsigned int get_position (const iterator &) const;
+
+      refptr<NotmuchThread> get_thread (const iterator &) const;
+      bool get_marked (const iterator &) const;
+      void set_marked (const iterator &, bool);
+
+      /* the marked threads are kept in a set, so that operations on them
+       * do not need to look at every row. */
+      unsigned int marked_count () const;
+
+      /* the marked threads that are visible */
+      std::vector<refptr<NotmuchThread>> get_marked_threads ();
+
+      /* these do not signal every changed row: redraw the view */
+      void toggle_marked_all ();
+      void unmark_all ();
+
+      /* the order new rows are inserted in, call resort () to apply it to
+       * the loaded rows */
+      void set_sort (SortOrder);
+
+      /* set while inserting or updating threads in message id order, the
+       * keys are kept until the sort order changes */
+      void set_sort_key_func (const SlotSortKey &);
+
+      /* sort the loaded rows, the view is told that the rows have been
+       * reordered so the cursor stays on its thread. */
+      void resort ();
+
+      /* add threads at the end. threads that are not in order are sorted
+       * and merged into the loaded rows. */
+      void append (const std::vector<refptr<NotmuchThread>> &);
+
+      /* add thread at its sorted position, or at the front when unsorted */
+      void insert (refptr<NotmuchThread>);
+
+      /* all loaded threads, whether they are visible or not */
+      void for_each_thread (std::function<void (const refptr<NotmuchThread> &)>) const;
+
+      /* look up a loaded thread, whether it is visible or not */
+      refptr<NotmuchThread> find (const ustring & thread_id) const;
+
+      /* the thread has been refreshed: re-position it and re-check whether
+       * it is visible */
+      void update (refptr<NotmuchThread>);
+      void erase (refptr<NotmuchThread>);
+      void clear ();
+
+      void set_visible_func (const SlotVisible &);
+      void refilter ();
+
+    protected:
+      /* Gtk::TreeModel */
+      Gtk::TreeModelFlags get_flags_vfunc () const override;
+      int   get_n_columns_vfunc () const override;
+      GType get_column_type_vfunc (int) const override;
+      void  get_value_vfunc (const iterator &, int, Glib::ValueBase &) const override;
+      void  set_value_impl (const iterator &, int, const Glib::ValueBase &) override;
+
+      bool  iter_next_vfunc (const iterator &, iterator &) const override;
+      bool  iter_children_vfunc (const iterator &, iterator &) const override;
+      bool  iter_has_child_vfunc (const iterator &) const override;
+      int   iter_n_children_vfunc (const iterator &) const override;
+      int   iter_n_root_children_vfunc () const override;
+      bool  iter_nth_child_vfunc (const iterator &, int, iterator &) const override;
+      bool  iter_nth_root_child_vfunc (int, iterator &) const override;
+      bool  iter_parent_vfunc (const iterator &, iterator &) const override;
+      Path  get_path_vfunc (const iterator &) const override;
+      bool  get_iter_vfunc (const Path &, iterator &) const override;
+
+    private:
+      struct Row {
+        refptr<NotmuchThread> thread;
+        std::string author; // sort key, lowercase first author
+      };
+
+      static Row make_row (const refptr<NotmuchThread> &);
+
+      std::vector<Row> rows;
+
+      std::unordered_map<const NotmuchThread *, refptr<NotmuchThread>> marked;
+
+      /* indices into rows of the visible rows, ascending. while refiltering
+       * the rows before the refilter position are in refilter_head, the
+       * remaining ones are still in visible. */
+      std::vector<unsigned int> visible;
+
+      bool refiltering = false;
+      std::vector<unsigned int> refilter_head;
+      unsigned int refilter_tail = 0;
+
+      unsigned int visible_size () const;
+      unsigned int visible_row (unsigned int) const;
+
+      SlotVisible visible_func;
+      bool is_visible (const refptr<NotmuchThread> &);
+
+      SortOrder sort = SortNewest;
+      bool sorted_before (const Row &, const Row &) const;
+
+      /* whether new rows can be put at their sorted position */
+      bool ordered () const;
+
+      SlotSortKey sort_key_func;
+      mutable std::unordered_map<const NotmuchThread *, std::string> sort_keys;
+      const std::string & sort_key (const NotmuchThread *) const;
+      static std::string author_key (const NotmuchThread *);
+
+      /* lists longer than this are sorted on several threads */
+      static const unsigned int PARALLEL_SORT_MIN = 20000;
+
+      /* move the rows to the order of the row indices in order, the view
+       * is told once */
+      void reorder (const std::vector<unsigned int> & order);
+
+      int stamp;
+      void invalidate_iters ();
+
+      bool valid (const iterator &) const;
+      void make_iter (unsigned int, iterator &) const;
+      static Path make_path (unsigned int);
+
+      /* insert row r at its sorted position, returns the index */
+      unsigned int insert_row (const refptr<NotmuchThread> &, bool front);
+
+      /* emit row-inserted for row r if it is visible */
+      void show_row (unsigned int r);
+
+      /* remove row r, emitting row-deleted if it was visible */
+      void remove_row (unsigned int r);
+
+      int find_row (const NotmuchThread *) const;
+  };
+}
+
@@ -2,6 +2,7 @@
 # include <algorithm>
 # include <vector>
 # include <functional>
+# include <limits>
 
 # include "db.hh"
 # include "modes/paned_mode.hh"
@@ -26,6 +27,7 @@
 # include "actions/toggle_action.hh"
 # include "actions/difftag_action.hh"
 # include "actions/cmdaction.hh"
+# include "utils/message_prefetch.hh"
 
 using namespace std;
 
@@ -61,27 +63,6 @@ namespace Astroid {
     list_view->remove_modal_grab ();
   }
 
-  /* ----------
-   * list store
-   * ----------
-   */
-  ThreadIndexListStore::ThreadIndexListStoreColumnRecord::ThreadIndexListStoreColumnRecord () {
-    add (newest_date);
-    add (oldest_date);
-    add (thread_id);
-    add (thread);
-    add (marked);
-  }
-
-  ThreadIndexListStore::ThreadIndexListStore () {
-    set_column_types (columns);
-  }
-
-  ThreadIndexListStore::~ThreadIndexListStore () {
-    LOG (debug) << "tils: deconstuct.";
-  }
-
-
   /* ---------
    * list view
    * ---------
@@ -94,13 +75,22 @@ namespace Astroid {
     thread_index    = _thread_index;
     main_window     = _thread_index->main_window;
     list_store      = store;
-    filtered_store  = Gtk::TreeModelFilter::create (list_store);
-    filtered_store->set_visible_func (sigc::mem_fun (this, &ThreadIndexListView::filter_visible_row));
+    list_store->set_visible_func (sigc::mem_fun (this, &ThreadIndexListView::filter_visible_row));
+
+    /* set up filter worker */
+    filter_generation = 0;
+    filter_ready.connect (
+        sigc::mem_fun (this, &ThreadIndexListView::on_filter_ready));
+
+    filter_run = true;
+    filter_worker_t = std::thread (&ThreadIndexListView::filter_worker, this);
 
     config = astroid->config ("thread_index");
     page_jump_rows     = config.get<int>("page_jump_rows");
+    prefetch_delay     = config.get<double>("prefetch.delay");
+    prefetch_unread    = config.get<int>("prefetch.unread");
 
-    set_model (filtered_store);
+    set_model (list_store);
     set_enable_search (false);
 
     set_show_expanders (false);
@@ -118,10 +108,24 @@ namespace Astroid {
     column->set_cell_data_func (*renderer,
         sigc::mem_fun(this, &ThreadIndexListView::set_thread_data) );
 
-    /* re-draw every minute (check every second) */
+    /* all rows have the same height, the view does not need to measure
+     * every row */
+    column->set_sizing (Gtk::TREE_VIEW_COLUMN_FIXED);
+    column->set_expand (true);
+    set_fixed_height_mode (true);
+
+    /* re-draw when relative dates change (check every second) */
     Glib::signal_timeout ().connect (
         sigc::mem_fun (this, &ThreadIndexListView::redraw), 1000);
 
+    /* show tag changes before they are written to the db */
+    astroid->actions->signal_tags_applied ().connect (
+        sigc::mem_fun (this, &ThreadIndexListView::queue_draw));
+
+    /* prefetch the thread under the cursor when it rests */
+    signal_cursor_changed ().connect (
+        sigc::mem_fun (this, &ThreadIndexListView::on_cursor_moved));
+
     /* mouse click */
     signal_row_activated ().connect (
         sigc::mem_fun (this, &ThreadIndexListView::on_my_row_activated));
@@ -237,21 +241,37 @@ namespace Astroid {
 
   ThreadIndexListView::~ThreadIndexListView () {
     LOG (debug) << "tilv: deconstruct.";
+
+    std::unique_lock<std::mutex> lk (filter_m);
+    filter_run = false;
+    filter_generation++;
+    lk.unlock ();
+
+    filter_cv.notify_one ();
+    filter_worker_t.join ();
+
+    bulk_progress_c.disconnect ();
+    prefetch_c.disconnect ();
   }
 
-  bool ThreadIndexListView::filter_visible_row ( const Gtk::TreeIter & iter)
+  bool ThreadIndexListView::filter_visible_row (const refptr<NotmuchThread> & t)
   {
-    if (filter.empty ()) return true;
+    if (filter_keys.empty ()) return true;
+    if (!t) return false;
 
-    if (iter) {
-      Gtk::ListStore::Row row = *iter;
-      refptr<NotmuchThread> t = row[list_store->columns.thread];
+    /* use the result of the filter worker if the thread has not changed
+     * since */
+    auto h = t->get_index_str ();
+    auto r = filter_results.find (t->thread_id.raw ());
 
-      if (t) return t->matches (filter);
-      else   return false;
+    if (r != filter_results.end () && r->second.first == h) {
+      return r->second.second;
     }
 
-    return true;
+    bool m = NotmuchThread::matches (*h, filter_keys);
+    filter_results[t->thread_id.raw ()] = std::make_pair (h, m);
+
+    return m;
   }
 
   void ThreadIndexListView::on_filter (ustring k) {
@@ -262,19 +282,144 @@ namespace Astroid {
     filter_txt  = k;
     filter      = VectorUtils::split_and_trim (k.lowercase (), " ");
 
-    filtered_store->refilter ();
+    std::vector<std::string> keys;
+    for (auto &f : filter) keys.push_back (f.raw ());
+
+    if (keys.empty ()) {
+      /* cancel any running filter and show all rows */
+      filter_generation++;
+      filter_keys.clear ();
+      filter_results.clear ();
+
+      list_store->refilter ();
+      thread_index->on_stats_ready ();
+      return;
+    }
+
+    std::unique_ptr<FilterJob> job (new FilterJob ());
+    job->generation = ++filter_generation;
+    job->keys       = keys;
+
+    /* the new filter narrows the applied filter if every applied key is
+     * contained in one of the new keys, only rows that matched need to be
+     * tested again. */
+    job->incremental = !filter_keys.empty () &&
+      std::all_of (filter_keys.begin (), filter_keys.end (),
+          [&] (const std::string &ok) {
+            return std::any_of (keys.begin (), keys.end (),
+                [&] (const std::string &nk) {
+                  return nk.find (ok) != std::string::npos;
+                });
+          });
+
+    if (job->incremental) {
+      for (auto &r : filter_results) {
+        if (r.second.second) {
+          job->candidates.push_back (std::make_pair (r.first, r.second.first));
+        }
+      }
+
+    } else {
+      job->candidates.reserve (list_store->total_size ());
+
+      list_store->for_each_thread ([&] (const refptr<NotmuchThread> & t) {
+          job->candidates.push_back (std::make_pair (t->thread_id.raw (), t->get_index_str ()));
+        });
+    }
+
+    LOG (debug) << "ti: filter: matching " << job->candidates.size () << " rows" << (job->incremental ? " (narrowing).." : "..");
+
+    std::unique_lock<std::mutex> lk (filter_m);
+    filter_job = std::move (job);
+    lk.unlock ();
+
+    filter_cv.notify_one ();
+  }
+
+  void ThreadIndexListView::filter_worker () {
+    std::unique_lock<std::mutex> lk (filter_m);
+
+    while (filter_run) {
+      filter_cv.wait (lk, [&] { return (filter_job || !filter_run); });
+
+      if (!filter_run) break;
+
+      std::unique_ptr<FilterJob> job = std::move (filter_job);
+      lk.unlock ();
+
+      bool cancelled = false;
+      job->results.reserve (job->candidates.size ());
+
+      for (unsigned int i = 0; i < job->candidates.size (); i++) {
+        /* a new filter has been requested */
+        if ((i % 1000) == 0 && filter_generation != job->generation) {
+          cancelled = true;
+          break;
+        }
+
+        job->results.push_back (NotmuchThread::matches (*job->candidates[i].second, job->keys));
+      }
+
+      lk.lock ();
+
+      if (!cancelled) {
+        filter_done = std::move (job);
+        filter_ready.emit ();
+      }
+    }
+  }
+
+  void ThreadIndexListView::on_filter_ready () {
+    std::unique_lock<std::mutex> lk (filter_m);
+    std::unique_ptr<FilterJob> job = std::move (filter_done);
+    lk.unlock ();
+
+    if (!job || job->generation != filter_generation) return; // superseded
+
+    if (job->incremental) {
+      /* rows that did not match the applied filter will not match this
+       * one either, rows that did are in the candidates. */
+      for (auto r = filter_results.begin (); r != filter_results.end (); ) {
+        if (r->second.second) r = filter_results.erase (r);
+        else r++;
+      }
+    } else {
+      filter_results.clear ();
+    }
+
+    for (unsigned int i = 0; i < job->candidates.size (); i++) {
+      filter_results[job->candidates[i].first] =
+        std::make_pair (job->candidates[i].second, job->results[i]);
+    }
+
+    filter_keys = job->keys;
+
+    list_store->refilter ();
 
     thread_index->on_stats_ready ();
   }
 
-  bool ThreadIndexListView::redraw () {
-    chrono::duration<double> elapsed = chrono::steady_clock::now() - last_redraw;
+  void ThreadIndexListView::clear_filter_results () {
+    /* the rows have been cleared, results are kept for the filter keys */
+    filter_results.clear ();
+  }
 
-    if (elapsed.count () >= 60) {
+  void ThreadIndexListView::erase_filter_result (const refptr<NotmuchThread> & t) {
+    /* the row has been erased */
+    filter_results.erase (t->thread_id.raw ());
+  }
 
-      queue_draw ();
-      last_redraw = chrono::steady_clock::now();
+  void ThreadIndexListView::on_style_updated () {
+    if (renderer) renderer->invalidate_cache ();
+    Gtk::TreeView::on_style_updated ();
+  }
 
+  bool ThreadIndexListView::redraw () {
+    /* redraw when the date of a visible row has gone stale (e.g. "3m ago"),
+     * the renderer updates date_expires when the rows are drawn again. */
+    if (renderer->date_expires <= time (NULL)) {
+      renderer->date_expires = std::numeric_limits<time_t>::max ();
+      queue_draw ();
     }
 
     return true;
@@ -290,24 +435,13 @@ namespace Astroid {
 
     //LOG (debug) << "setting thread.." << r;
     if (iter) {
-
-      Gtk::ListStore::Row row = *iter;
-      r->thread = row[list_store->columns.thread];
-      r->marked = row[list_store->columns.marked];
-
+      r->thread = list_store->get_thread (iter);
+      r->marked = list_store->get_marked (iter);
     }
   }
 
-  void ThreadIndexListView::set_sort_type (notmuch_sort_t sort) {
-    if (sort == NOTMUCH_SORT_NEWEST_FIRST) {
-      list_store->set_sort_column (0, Gtk::SortType::SORT_DESCENDING);
-    } else if (sort == NOTMUCH_SORT_OLDEST_FIRST) {
-      list_store->set_sort_column (1, Gtk::SortType::SORT_ASCENDING);
-    } else {
-      // TODO: NOTMUCH_SORT_MESSAGE_ID
-
-      list_store->set_sort_column (Gtk::TreeSortable::DEFAULT_UNSORTED_COLUMN_ID, Gtk::SortType::SORT_ASCENDING);
-    }
+  void ThreadIndexListView::set_sort_type (ThreadIndexListStore::SortOrder sort) {
+    list_store->set_sort (sort);
   }
 
   void ThreadIndexListView::register_keys () { // {{{
@@ -317,7 +451,7 @@ namespace Astroid {
     keys->register_key ("j", { Key(false, false, (guint) GDK_KEY_Down) },
         "thread_index.next_thread", "Next thread",
         [&](Key) {
-          if (filtered_store->children().size() < 2)
+          if (list_store->size () < 2)
             return true;
 
           Gtk::TreePath path;
@@ -325,7 +459,7 @@ namespace Astroid {
           get_cursor (path, c);
 
           path.next ();
-          Gtk::TreeIter it = filtered_store->get_iter (path);
+          Gtk::TreeIter it = list_store->get_iter (path);
 
           if (it) {
             set_cursor (path);
@@ -337,49 +471,23 @@ namespace Astroid {
         "thread_index.next_unread",
         "Jump to next unread thread",
         [&] (Key) {
-          Gtk::TreePath thispath, path;
-          Gtk::TreeIter fwditer;
+          unsigned int n = list_store->size ();
+          if (n < 1) return true;
+
+          Gtk::TreePath path;
           Gtk::TreeViewColumn *c;
 
           get_cursor (path, c);
-          path.next ();
-          fwditer = filtered_store->get_iter (path);
-          thispath = path;
+          unsigned int cur = path ? path[0] : 0;
 
-          Gtk::ListStore::Row row;
+          /* search forward, wrapping around to the current row */
+          for (unsigned int i = 1; i <= n; i++) {
+            auto it = list_store->iter_at ((cur + i) % n);
 
-          bool found = false;
-          while (fwditer) {
-            row = *fwditer;
-
-            Glib::RefPtr<NotmuchThread> thread = row[list_store->columns.thread];
-            if (thread->unread) {
-              path = filtered_store->get_path (fwditer);
-              set_cursor (path);
-              found = true;
-              break;
-            }
-
-            fwditer++;
-          }
-
-          /* wrap, and check from start */
-          if (!found) {
-            fwditer = filtered_store->children().begin ();
-
-            while (fwditer && filtered_store->get_path(fwditer) < thispath) {
-            row = *fwditer;
-
-            Glib::RefPtr<NotmuchThread> thread = row[list_store->columns.thread];
-            if (thread->unread) {
-              path = filtered_store->get_path (fwditer);
-              set_cursor (path);
-              found = true;
+            if (list_store->get_thread (it)->unread) {
+              set_cursor (list_store->get_path (it));
               break;
             }
-
-            fwditer++;
-            }
           }
 
           return true;
@@ -389,50 +497,23 @@ namespace Astroid {
         "thread_index.previous_unread",
         "Jump to previous unread thread",
         [&] (Key) {
-          Gtk::TreePath thispath, path;
-          Gtk::TreeIter iter;
+          unsigned int n = list_store->size ();
+          if (n < 1) return true;
+
+          Gtk::TreePath path;
           Gtk::TreeViewColumn *c;
 
           get_cursor (path, c);
-          thispath = path;
-
-          path.prev ();
-          iter = filtered_store->get_iter (path);
+          unsigned int cur = path ? path[0] : 0;
 
-          Gtk::ListStore::Row row;
+          /* search backward, wrapping around to the current row */
+          for (unsigned int i = 1; i <= n; i++) {
+            auto it = list_store->iter_at ((cur + n - i) % n);
 
-          bool found = false;
-          while (iter && filtered_store->get_path(iter) < thispath) {
-            row = *iter;
-
-            Glib::RefPtr<NotmuchThread> thread = row[list_store->columns.thread];
-            if (thread->unread) {
-              path = filtered_store->get_path (iter);
-              set_cursor (path);
-              found = true;
+            if (list_store->get_thread (it)->unread) {
+              set_cursor (list_store->get_path (it));
               break;
             }
-
-            iter--;
-          }
-
-          /* wrap, and check from end */
-          if (!found) {
-            iter = filtered_store->children().end ();
-            iter--;
-
-            while (iter && filtered_store->get_path(iter) > thispath) {
-              row = *iter;
-
-              Glib::RefPtr<NotmuchThread> thread = row[list_store->columns.thread];
-              if (thread->unread) {
-                path = filtered_store->get_path (iter);
-                set_cursor (path);
-                break;
-              }
-
-              iter--;
-            }
           }
 
           return true;
@@ -514,25 +595,7 @@ namespace Astroid {
           [&] (Key k) {
 
             /* check if anything is marked */
-            Gtk::TreePath path;
-            Gtk::TreeIter fwditer;
-
-            fwditer = filtered_store->get_iter ("0");
-            Gtk::ListStore::Row row;
-
-            bool found = false;
-
-            while (fwditer) {
-              row = *fwditer;
-              if (row[list_store->columns.marked]) {
-                found = true;
-                break;
-              }
-
-              fwditer++;
-            }
-
-            if (found) {
+            if (!list_store->get_marked_threads ().empty ()) {
               thread_index->multi_key (multi_keys, k);
             }
 
@@ -542,7 +605,7 @@ namespace Astroid {
     keys->register_key ("J", "thread_index.scroll_down",
         "Scroll down",
         [&] (Key) {
-          if (filtered_store->children().size() >= 2) {
+          if (list_store->size () >= 2) {
 
             Gtk::TreePath path;
             Gtk::TreeViewColumn *c;
@@ -553,14 +616,13 @@ namespace Astroid {
               path.next ();
             }
 
-            Gtk::TreeIter it = filtered_store->get_iter (path);
+            Gtk::TreeIter it = list_store->get_iter (path);
 
             if (it) {
               set_cursor (path);
             } else {
               /* move to last */
-              auto it = filtered_store->children().end ();
-              auto p  = filtered_store->get_path (--it);
+              auto p = list_store->get_path (list_store->iter_at (list_store->size () - 1));
               if (p) set_cursor (p);
             }
           }
@@ -601,9 +663,8 @@ namespace Astroid {
     keys->register_key ("0", { Key (GDK_KEY_End) }, "thread_index.scroll_end",
         "Scroll to last line",
         [&] (Key) {
-          if (filtered_store->children().size() >= 1) {
-            auto it = filtered_store->children().end ();
-            auto p  = filtered_store->get_path (--it);
+          if (list_store->size () >= 1) {
+            auto p = list_store->get_path (list_store->iter_at (list_store->size () - 1));
             if (p) set_cursor (p);
           }
 
@@ -778,7 +839,7 @@ namespace Astroid {
     keys->register_key ("t", "thread_index.toggle_marked_next",
         "Toggle mark thread and move to next",
         [&] (Key) {
-          if (list_store->children().size() < 1)
+          if (list_store->size () < 1)
             return true;
 
           Gtk::TreePath path;
@@ -786,15 +847,14 @@ namespace Astroid {
           get_cursor (path, c);
           Gtk::TreeIter iter;
 
-          iter = filtered_store->get_iter (path);
+          iter = list_store->get_iter (path);
 
           if (iter) {
-            Gtk::ListStore::Row row = *iter;
-            row[list_store->columns.marked] = !row[list_store->columns.marked];
+            list_store->set_marked (iter, !list_store->get_marked (iter));
 
             /* move to next thread */
             path.next ();
-            iter = filtered_store->get_iter (path);
+            iter = list_store->get_iter (path);
             if (iter) set_cursor (path);
           }
 
@@ -804,7 +864,7 @@ namespace Astroid {
     keys->register_key (UnboundKey (), "thread_index.toggle_marked",
         "Toggle mark thread",
         [&] (Key) {
-          if (list_store->children().size() < 1)
+          if (list_store->size () < 1)
             return true;
 
           Gtk::TreePath path;
@@ -812,11 +872,10 @@ namespace Astroid {
           get_cursor (path, c);
           Gtk::TreeIter iter;
 
-          iter = filtered_store->get_iter (path);
+          iter = list_store->get_iter (path);
 
           if (iter) {
-            Gtk::ListStore::Row row = *iter;
-            row[list_store->columns.marked] = !row[list_store->columns.marked];
+            list_store->set_marked (iter, !list_store->get_marked (iter));
           }
 
           return true;
@@ -825,7 +884,7 @@ namespace Astroid {
     keys->register_key (UnboundKey (), "thread_index.toggle_marked_previous",
         "Toggle mark thread and move to previous",
         [&] (Key) {
-          if (filtered_store->children().size() < 1)
+          if (list_store->size () < 1)
             return true;
 
           Gtk::TreePath path;
@@ -833,11 +892,10 @@ namespace Astroid {
           get_cursor (path, c);
           Gtk::TreeIter iter;
 
-          iter = filtered_store->get_iter (path);
+          iter = list_store->get_iter (path);
 
           if (iter) {
-            Gtk::ListStore::Row row = *iter;
-            row[list_store->columns.marked] = !row[list_store->columns.marked];
+            list_store->set_marked (iter, !list_store->get_marked (iter));
 
             /* move to previous */
             path.prev ();
@@ -852,18 +910,23 @@ namespace Astroid {
     keys->register_key ("T", "thread_index.toggle_marked_all",
         "Toggle marked on all loaded threads",
         [&] (Key) {
-          Gtk::TreePath path;
-          Gtk::TreeIter fwditer;
-          fwditer = filtered_store->get_iter ("0");
-          Gtk::ListStore::Row row;
-          while (fwditer) {
-            row = *fwditer;
-            row[list_store->columns.marked] = !row[list_store->columns.marked];
-            fwditer++;
-          }
+          list_store->toggle_marked_all ();
+          queue_draw ();
           return true;
         });
 
+    keys->register_key ("C-g", "thread_index.cancel_multi",
+        "Cancel action on marked threads",
+        [&] (Key) {
+          if (bulk_action && !bulk_action->finished) {
+            LOG (info) << "tl: cancelling action on marked threads..";
+            bulk_action->cancel ();
+            return true;
+          }
+
+          return false;
+        });
+
     keys->register_key ("a", "thread_index.archive",
         "Toggle 'inbox' tag on thread",
         [&] (Key) {
@@ -1030,15 +1093,6 @@ namespace Astroid {
       Key) {
     LOG (debug) << "tl: m k h";
 
-    Gtk::TreePath path;
-    Gtk::TreeIter fwditer;
-
-    /* forward iterating is much faster than going backwards:
-     * https://developer.gnome.org/gtkmm/3.11/classGtk_1_1TreeIter.html
-     */
-    fwditer = filtered_store->get_iter ("0");
-    Gtk::ListStore::Row row;
-
     switch (maction) {
       case MFlag:
       case MUnread:
@@ -1049,17 +1103,8 @@ namespace Astroid {
         {
           vector<refptr<NotmuchItem>> threads;
 
-          while (fwditer) {
-            row = *fwditer;
-            if (row[list_store->columns.marked]) {
-
-              // row[list_store->columns.marked] = false;
-              refptr<NotmuchThread> thread = row[list_store->columns.thread];
-
-              threads.push_back (refptr<NotmuchItem>::cast_dynamic(thread));
-            }
-
-            fwditer++;
+          for (auto & t : list_store->get_marked_threads ()) {
+            threads.push_back (refptr<NotmuchItem>::cast_dynamic (t));
           }
 
           refptr<Action> a;
@@ -1094,7 +1139,7 @@ namespace Astroid {
 
                       refptr<Action> ma = refptr<DiffTagAction> (DiffTagAction::create (threads, tgs));
                       if (ma) {
-                        main_window->actions->doit (ma);
+                        start_bulk (ma);
                       }
                     });
                 return true;
@@ -1106,7 +1151,7 @@ namespace Astroid {
           }
 
           if ((maction != MTag) && a) {
-            main_window->actions->doit (a);
+            start_bulk (a);
           }
 
           return true;
@@ -1115,16 +1160,8 @@ namespace Astroid {
 
       case MToggle:
         {
-          while (fwditer) {
-            row = *fwditer;
-            if (row[list_store->columns.marked]) {
-
-              row[list_store->columns.marked] = false;
-
-            }
-
-            fwditer++;
-          }
+          list_store->unmark_all ();
+          queue_draw ();
 
           return true;
         }
@@ -1132,6 +1169,35 @@ namespace Astroid {
     return false;
   }
 
+  void ThreadIndexListView::start_bulk (refptr<Action> a) {
+    bulk_action = a;
+    main_window->actions->doit (a);
+
+    if (!bulk_progress_c.connected ()) {
+      bulk_progress_c = Glib::signal_timeout ().connect (
+          sigc::mem_fun (this, &ThreadIndexListView::on_bulk_progress), 200);
+    }
+  }
+
+  bool ThreadIndexListView::on_bulk_progress () {
+    bool done = !bulk_action || bulk_action->finished;
+
+    if (done) bulk_action.reset ();
+
+    thread_index->on_stats_ready ();
+
+    return !done;
+  }
+
+  ustring ThreadIndexListView::get_bulk_progress () {
+    if (!bulk_action || bulk_action->finished) return "";
+
+    if (bulk_action->cancelled ()) return " (cancelling)";
+
+    return ustring::compose (" (tagging: %1/%2)",
+        bulk_action->progress.load (), bulk_action->total.load ());
+  }
+
   bool ThreadIndexListView::on_key_press_event (GdkEventKey * e) {
     /* bypass scrolled window */
     return thread_index->on_key_press_event (e);
@@ -1240,7 +1306,7 @@ namespace Astroid {
   }
 
   void ThreadIndexListView::update_bg_image () {
-    bool hide = (!filter_txt.empty () && filtered_store->children().size () == 0) || (filter_txt.empty () && thread_index->queryloader.total_messages == 0);
+    bool hide = (!filter_txt.empty () && list_store->size () == 0) || (filter_txt.empty () && thread_index->queryloader.total_messages == 0);
 
     if (!hide) {
       auto sc = get_style_context ();
@@ -1273,42 +1339,58 @@ namespace Astroid {
   */
 
   refptr<NotmuchThread> ThreadIndexListView::get_current_thread () {
-    if (list_store->children().size() < 1)
+    if (list_store->size () < 1)
       return refptr<NotmuchThread>();
 
     Gtk::TreePath path;
     Gtk::TreeViewColumn *c;
     get_cursor (path, c);
-    Gtk::TreeIter iter;
 
-    iter = filtered_store->get_iter (path);
+    return list_store->get_thread (list_store->get_iter (path));
+  }
 
-    if (iter) {
-      Gtk::ListStore::Row row = *iter;
-      return row[list_store->columns.thread];
+  void ThreadIndexListView::on_cursor_moved () {
+    if (!astroid->prefetch || !astroid->prefetch->enabled ()) return;
 
-    } else {
-      return refptr<NotmuchThread>();
-    }
-  }
+    /* drop what was queued for the previous row */
+    prefetch_c.disconnect ();
+    astroid->prefetch->cancel ();
 
-  ustring ThreadIndexListView::get_current_thread_id () {
-    if (list_store->children().size() < 1)
-      return "";
+    prefetch_c = Glib::signal_timeout ().connect (
+        sigc::mem_fun (this, &ThreadIndexListView::on_prefetch),
+        std::max (0, (int) (prefetch_delay * 1000)));
+  }
 
+  bool ThreadIndexListView::on_prefetch () {
     Gtk::TreePath path;
     Gtk::TreeViewColumn *c;
     get_cursor (path, c);
-    Gtk::TreeIter iter;
 
-    iter = filtered_store->get_iter (path);
+    auto it = list_store->get_iter (path);
+    if (!it) return false;
 
-    if (iter) {
-      Gtk::ListStore::Row row = *iter;
-      ustring thread_id = row[list_store->columns.thread_id];
+    std::vector<ustring> thread_ids;
+    thread_ids.push_back (list_store->get_thread (it)->thread_id);
 
-      return thread_id;
+    /* and the next unread threads */
+    for (unsigned int i = list_store->get_position (it) + 1;
+         i < list_store->size () && (int) thread_ids.size () <= prefetch_unread; i++) {
 
+      auto t = list_store->get_thread (list_store->iter_at (i));
+      if (t->unread) thread_ids.push_back (t->thread_id);
+    }
+
+    LOG (debug) << "tl: prefetching " << thread_ids.size () << " threads..";
+    astroid->prefetch->request (thread_ids);
+
+    return false;
+  }
+
+  ustring ThreadIndexListView::get_current_thread_id () {
+    auto thread = get_current_thread ();
+
+    if (thread) {
+      return thread->thread_id;
     } else {
       return "";
     }
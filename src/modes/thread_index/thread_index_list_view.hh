@@ -1,15 +1,21 @@
 # pragma once
 
 # include <chrono>
+# include <thread>
+# include <mutex>
+# include <condition_variable>
+# include <atomic>
+# include <memory>
+# include <unordered_map>
 
 # include <gtkmm.h>
-# include <gtkmm/liststore.h>
 # include <gtkmm/treeview.h>
 
 # include "proto.hh"
 # include "config.hh"
 # include "modes/mode.hh"
 # include "modes/keybindings.hh"
+# include "thread_index_list_store.hh"
 
 # include "notmuch.h"
 
@@ -17,33 +23,9 @@ namespace Astroid {
   /* the list view consists of:
    * - a scolled window (which may be paned)
    * - a Treeview
-   * - a ListStore
+   * - a ThreadIndexListStore
    */
 
-  /* ----------
-   * list store
-   * ----------
-   */
-  class ThreadIndexListStore : public Gtk::ListStore {
-    public:
-      class ThreadIndexListStoreColumnRecord : public Gtk::TreeModel::ColumnRecord
-      {
-        public:
-          Gtk::TreeModelColumn<time_t> newest_date;
-          Gtk::TreeModelColumn<time_t> oldest_date;
-          Gtk::TreeModelColumn<Glib::ustring> thread_id;
-          Gtk::TreeModelColumn<Glib::RefPtr<NotmuchThread>> thread;
-          Gtk::TreeModelColumn<bool> marked;
-
-          ThreadIndexListStoreColumnRecord ();
-      };
-
-      ThreadIndexListStore ();
-      ~ThreadIndexListStore ();
-      const ThreadIndexListStoreColumnRecord columns;
-  };
-
-
   /* ---------
    * list view
    * ---------
@@ -58,23 +40,68 @@ namespace Astroid {
       ThreadIndex * thread_index;
       MainWindow  * main_window;
       refptr<ThreadIndexListStore> list_store;
-      refptr<Gtk::TreeModelFilter> filtered_store;
 
-      ThreadIndexListCellRenderer * renderer;
+      ThreadIndexListCellRenderer * renderer = NULL;
       int page_jump_rows; // rows to jump
 
+      /* the thread under the cursor and the next unread threads are
+       * prefetched when the cursor has rested for prefetch_delay
+       * seconds */
+      double prefetch_delay;
+      int    prefetch_unread;
+      sigc::connection prefetch_c;
+      void on_cursor_moved ();
+      bool on_prefetch ();
+
       void set_thread_data (Gtk::CellRenderer *, const Gtk::TreeIter & );
 
       ustring get_current_thread_id ();
       refptr<NotmuchThread> get_current_thread ();
 
       void update_bg_image ();
-      void set_sort_type (notmuch_sort_t sort);
+      void set_sort_type (ThreadIndexListStore::SortOrder sort);
 
-      bool filter_visible_row ( const Gtk::TreeIter & iter );
+      bool filter_visible_row (const refptr<NotmuchThread> &);
       ustring              filter_txt;
       std::vector<ustring> filter;
       void on_filter (ustring k);
+      void clear_filter_results ();
+      void erase_filter_result (const refptr<NotmuchThread> &);
+
+    private:
+      /* filtering: the rows are matched on the filter worker thread, a new
+       * filter cancels the running one. when the new filter narrows the
+       * applied one only the rows that still match are tested again. the
+       * results are applied on the gui thread, rows that have been
+       * added or changed since are matched when they are shown. */
+      typedef std::pair<std::string, std::shared_ptr<const std::string>> FilterCandidate;
+
+      struct FilterJob {
+        unsigned long generation;
+        bool          incremental;
+        std::vector<std::string>     keys;
+        std::vector<FilterCandidate> candidates;
+        std::vector<bool>            results;
+      };
+
+      /* keys of the applied filter, with the results by thread id */
+      std::vector<std::string> filter_keys;
+      std::unordered_map<std::string, std::pair<std::shared_ptr<const std::string>, bool>> filter_results;
+
+      std::atomic<unsigned long> filter_generation;
+      bool filter_run = false;
+      std::thread filter_worker_t;
+      void filter_worker ();
+
+      std::mutex filter_m;
+      std::condition_variable filter_cv;
+      std::unique_ptr<FilterJob> filter_job;
+      std::unique_ptr<FilterJob> filter_done;
+
+      Glib::Dispatcher filter_ready;
+      void on_filter_ready ();
+
+    public:
 
 
     protected:
@@ -93,6 +120,18 @@ namespace Astroid {
 
       bool multi_key_handler (multi_key_action, Key);
 
+      /* the last action on the marked threads, its progress is shown in
+       * the label until it is done. */
+      refptr<Action> bulk_action;
+      sigc::connection bulk_progress_c;
+      void start_bulk (refptr<Action>);
+      bool on_bulk_progress ();
+
+    public:
+      ustring get_bulk_progress ();
+
+    protected:
+
       void on_my_row_activated  (const Gtk::TreeModel::Path &, Gtk::TreeViewColumn *);
 
       virtual bool on_button_press_event (GdkEventButton *) override;
@@ -112,8 +151,10 @@ namespace Astroid {
       // bypass scrolled window
       virtual bool on_key_press_event (GdkEventKey *) override;
 
+      /* font or theme changed */
+      virtual void on_style_updated () override;
+
     private:
-      std::chrono::time_point<std::chrono::steady_clock> last_redraw;
       bool redraw ();
   };
 
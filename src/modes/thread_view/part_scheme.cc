@@ -0,0 +1,161 @@
+# include <string>
+# include <mutex>
+
+# include <gio/gio.h>
+# include <webkit/webkit.h>
+# include <libsoup/soup.h>
+
+# include "part_scheme.hh"
+# include "astroid.hh"
+# include "utils/ustring_utils.hh"
+
+/* SoupRequest serving the registered parts */
+extern "C" {
+  typedef struct {
+    SoupRequest parent;
+
+    GBytes *    data;
+    gchar *     mime_type;
+  } AstroidPartRequest;
+
+  typedef struct {
+    SoupRequestClass parent_class;
+  } AstroidPartRequestClass;
+}
+
+G_DEFINE_TYPE (AstroidPartRequest, astroid_part_request, SOUP_TYPE_REQUEST)
+
+static const char * astroid_part_request_schemes[] = { "astroid-part", NULL };
+
+static void astroid_part_request_init (AstroidPartRequest * r) {
+  r->data      = NULL;
+  r->mime_type = NULL;
+}
+
+static void astroid_part_request_finalize (GObject * object) {
+  AstroidPartRequest * r = (AstroidPartRequest *) object;
+
+  if (r->data) g_bytes_unref (r->data);
+  g_free (r->mime_type);
+
+  G_OBJECT_CLASS (astroid_part_request_parent_class)->finalize (object);
+}
+
+static GInputStream * astroid_part_request_send (
+    SoupRequest  * request,
+    GCancellable * /* cancellable */,
+    GError      ** error)
+{
+  AstroidPartRequest * r = (AstroidPartRequest *) request;
+
+  gchar * uri = soup_uri_to_string (soup_request_get_uri (request), FALSE);
+
+  GBytes *    data;
+  std::string mime_type;
+
+  if (!Astroid::PartScheme::lookup (uri, data, mime_type)) {
+    LOG (debug) << "part scheme: no such part: " << uri;
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "no such part: %s", uri);
+    g_free (uri);
+    return NULL;
+  }
+
+  g_free (uri);
+
+  if (r->data) g_bytes_unref (r->data);
+  g_free (r->mime_type);
+
+  r->data      = data;
+  r->mime_type = g_strdup (mime_type.c_str ());
+
+  return g_memory_input_stream_new_from_bytes (r->data);
+}
+
+static goffset astroid_part_request_get_content_length (SoupRequest * request) {
+  AstroidPartRequest * r = (AstroidPartRequest *) request;
+  return (r->data ? g_bytes_get_size (r->data) : -1);
+}
+
+static const char * astroid_part_request_get_content_type (SoupRequest * request) {
+  AstroidPartRequest * r = (AstroidPartRequest *) request;
+  return (r->mime_type ? r->mime_type : "application/octet-stream");
+}
+
+static void astroid_part_request_class_init (AstroidPartRequestClass * klass) {
+  GObjectClass *     object_class  = G_OBJECT_CLASS (klass);
+  SoupRequestClass * request_class = SOUP_REQUEST_CLASS (klass);
+
+  object_class->finalize = astroid_part_request_finalize;
+
+  request_class->schemes            = astroid_part_request_schemes;
+  request_class->send               = astroid_part_request_send;
+  request_class->get_content_length = astroid_part_request_get_content_length;
+  request_class->get_content_type   = astroid_part_request_get_content_type;
+}
+
+namespace Astroid {
+  const char * PartScheme::SCHEME = "astroid-part";
+
+  bool PartScheme::initialized = false;
+  std::mutex PartScheme::parts_m;
+  std::map<std::string, std::pair<std::string, GBytes *>> PartScheme::parts;
+
+  void PartScheme::init () {
+    if (initialized) return;
+
+    LOG (debug) << "part scheme: registering " << SCHEME << " scheme..";
+
+    soup_session_add_feature_by_type (webkit_get_default_session (),
+        astroid_part_request_get_type ());
+
+    initialized = true;
+  }
+
+  ustring PartScheme::make_prefix () {
+    return ustring::compose ("%1://part/%2/", SCHEME,
+        UstringUtils::random_alphanumeric (30));
+  }
+
+  ustring PartScheme::add (ustring prefix, ustring name, ustring mime_type, GBytes * data) {
+    ustring uri = prefix + name;
+
+    std::lock_guard<std::mutex> lk (parts_m);
+
+    auto p = parts.find (uri);
+    if (p != parts.end ()) {
+      g_bytes_unref (p->second.second);
+      parts.erase (p);
+    }
+
+    parts[uri] = std::make_pair (std::string (mime_type), data);
+
+    return uri;
+  }
+
+  void PartScheme::remove (ustring prefix) {
+    if (prefix.empty ()) return;
+
+    std::string pf (prefix);
+
+    std::lock_guard<std::mutex> lk (parts_m);
+
+    auto p = parts.lower_bound (pf);
+    while (p != parts.end () && p->first.compare (0, pf.length (), pf) == 0) {
+      g_bytes_unref (p->second.second);
+      p = parts.erase (p);
+    }
+  }
+
+  bool PartScheme::lookup (std::string uri, GBytes *& data, std::string & mime_type) {
+    std::lock_guard<std::mutex> lk (parts_m);
+
+    auto p = parts.find (uri);
+    if (p == parts.end ()) return false;
+
+    mime_type = p->second.first;
+    data      = g_bytes_ref (p->second.second);
+
+    return true;
+  }
+}
+
@@ -0,0 +1,47 @@
+# pragma once
+
+# include <map>
+# include <mutex>
+# include <string>
+
+# include <glib.h>
+
+# include "proto.hh"
+
+namespace Astroid {
+  /* serves the contents of message parts (inline cid: images and attachment
+   * previews) to webkit through the astroid-part: uri scheme, so that they
+   * do not have to be encoded as base64 data uris in the dom.
+   *
+   * the scheme is registered as a SoupRequest on the default webkit
+   * session. every thread view owns a prefix under which its parts are
+   * registered, the parts are dropped when the prefix is removed. */
+  class PartScheme {
+    public:
+      static const char * SCHEME;
+
+      /* register the scheme with webkit, safe to call more than once */
+      static void init ();
+
+      /* make a new unique prefix */
+      static ustring make_prefix ();
+
+      /* register data under prefix and return the uri, the scheme takes
+       * ownership of data. */
+      static ustring add (ustring prefix, ustring name, ustring mime_type, GBytes * data);
+
+      /* drop all parts registered under prefix */
+      static void remove (ustring prefix);
+
+      /* look up part, returns a new reference to the data. may be called
+       * from any thread. */
+      static bool lookup (std::string uri, GBytes *& data, std::string & mime_type);
+
+    private:
+      static bool initialized;
+
+      static std::mutex parts_m;
+      static std::map<std::string, std::pair<std::string, GBytes *>> parts; // uri, (mime type, data)
+  };
+}
+
@@ -12,6 +12,7 @@
 # include "thread_view.hh"
 # include "web_inspector.hh"
 # include "dom_utils.hh"
+# include "part_scheme.hh"
 # include "theme.hh"
 
 # include "main_window.hh"
@@ -24,6 +25,7 @@
 # include "utils/vector_utils.hh"
 # include "utils/ustring_utils.hh"
 # include "utils/gravatar.hh"
+# include "utils/avatar_cache.hh"
 # include "utils/cmd.hh"
 # include "utils/gmime/gmime-compat.h"
 # ifndef DISABLE_PLUGINS
@@ -158,6 +160,8 @@ namespace Astroid {
         G_CALLBACK(ThreadView_resource_request_starting),
         (gpointer) this);
 
+    PartScheme::init ();
+
     /* scrolled window */
     auto vadj = scroll.get_vadjustment ();
     vadj->signal_changed().connect (
@@ -180,6 +184,9 @@ namespace Astroid {
 
     register_keys ();
 
+    astroid->avatars->signal_avatar_ready ().connect (
+        sigc::mem_fun (this, &ThreadView::on_avatar_ready));
+
     show_all_children ();
 
 # ifndef DISABLE_PLUGINS
@@ -200,6 +207,9 @@ namespace Astroid {
   }
 
   void ThreadView::pre_close () {
+    log_request_stats ();
+    PartScheme::remove (part_uri);
+
 # ifndef DISABLE_PLUGINS
     plugins->deactivate ();
     delete plugins;
@@ -237,11 +247,58 @@ namespace Astroid {
       return;
     }
 
-    const gchar * uri_c = webkit_network_request_get_uri (request);
-    ustring uri (uri_c);
+    chrono::time_point<chrono::steady_clock> t0 = chrono::steady_clock::now ();
+
+    std::string uri (webkit_network_request_get_uri (request));
+
+    request_stats.requests++;
+
+    if (uri.compare (0, 4, "cid:") == 0) {
+      /* inline part referenced by content id, served from the parsed
+       * message through the part scheme */
+      ustring puri = get_cid_uri (Glib::uri_unescape_string (uri.substr (4)));
+
+      if (!puri.empty ()) {
+        webkit_network_request_set_uri (request, puri.c_str ());
+        uri = puri;
+      }
+    }
+
+    /* is this request allowed */
+    if (!show_remote_images && denied_uris.count (uri)) {
+      /* denied before, e.g. a repeated tracking pixel */
+      request_stats.cached++;
+      request_stats.denied++;
+      webkit_network_request_set_uri (request, "about:blank"); // no
+
+    } else if (is_allowed_uri (uri)) {
+      /* LOG (debug) << "tv: request: allowed: " << uri; */
+
+    } else {
+      if (show_remote_images) {
+        // TODO: use an approved-url (like geary) to only allow imgs, not JS
+        //       or other content.
+        LOG (warn) << "tv: remote images allowed, approving _all_ requests: " << uri;
+
+      } else {
+        LOG (debug)<< "tv: request: denied: " << uri;
+        denied_uris.insert (uri);
+        request_stats.denied++;
+        webkit_network_request_set_uri (request, "about:blank"); // no
+      }
+    }
+
+    request_stats.time += chrono::duration_cast<chrono::microseconds> (
+        chrono::steady_clock::now () - t0);
+  }
+
+  void ThreadView::build_allowed_uris () {
+    /* the allowed uri prefixes only change with the home uri, or when the
+     * plugins are (re-)loaded. they are built once for each render rather
+     * than for every request. */
 
     // prefix of local uris for loading image thumbnails
-    vector<ustring> allowed_uris =
+    allowed_uris =
       {
         home_uri,
         "data:image/png;base64",
@@ -252,6 +309,8 @@ namespace Astroid {
       allowed_uris.push_back ("https://www.gravatar.com/avatar/");
     }
 
+    allowed_uris.push_back (part_uri);
+
     if (enable_code_prettify) {
       allowed_uris.push_back (code_prettify_uri.substr (0, code_prettify_uri.rfind ("/")));
     }
@@ -265,29 +324,73 @@ namespace Astroid {
     }
 # endif
 
-    // TODO: show cid type images and inline-attachments
+    /* sort bytewise and drop every prefix that is covered by a shorter
+     * one: in the remaining set the only candidate for a prefix of an uri is
+     * the greatest entry not greater than the uri itself. */
+    std::sort (allowed_uris.begin (), allowed_uris.end ());
 
-    /* is this request allowed */
-    if (find_if (allowed_uris.begin (), allowed_uris.end (),
-          [&](ustring &a) {
-            return (uri.substr (0, a.length ()) == a);
-          }) != allowed_uris.end ())
-    {
+    auto last = std::unique (allowed_uris.begin (), allowed_uris.end (),
+        [&] (const std::string &a, const std::string &b) {
+          return b.compare (0, a.length (), a) == 0;
+        });
 
-      /* LOG (debug) << "tv: request: allowed: " << uri; */
-      return; // yes
+    allowed_uris.erase (last, allowed_uris.end ());
 
-    } else {
-      if (show_remote_images) {
-        // TODO: use an approved-url (like geary) to only allow imgs, not JS
-        //       or other content.
-        LOG (warn) << "tv: remote images allowed, approving _all_ requests: " << uri;
-        return; // yes
-      } else {
-        LOG (debug)<< "tv: request: denied: " << uri;
-        webkit_network_request_set_uri (request, "about:blank"); // no
+    denied_uris.clear ();
+  }
+
+  bool ThreadView::is_allowed_uri (const std::string &uri) {
+    auto a = std::upper_bound (allowed_uris.begin (), allowed_uris.end (), uri);
+
+    if (a == allowed_uris.begin ()) return false;
+    a--;
+
+    return (uri.compare (0, a->length (), *a) == 0);
+  }
+
+  ustring ThreadView::get_cid_uri (ustring cid) {
+    auto u = cid_uris.find (cid);
+    if (u != cid_uris.end ()) return u->second;
+
+    ustring uri;
+
+    if (mthread) {
+      for (auto &m : mthread->messages) {
+        if (!m->root) continue;
+
+        refptr<Chunk> c = (m->root->content_id == cid ? m->root : m->root->get_by_content_id (cid));
+
+        if (c) {
+          /* the part scheme holds a reference to the decoded contents */
+          refptr<Glib::ByteArray> d = c->contents ();
+          GByteArray * ba = g_byte_array_ref (d->gobj ());
+
+          uri = PartScheme::add (part_uri, ustring::compose ("%1", c->id),
+              c->get_content_type (),
+              g_bytes_new_with_free_func (ba->data, ba->len,
+                (GDestroyNotify) g_byte_array_unref, ba));
+
+          LOG (debug) << "tv: serving cid: " << cid << " as: " << uri;
+          break;
+        }
       }
     }
+
+    cid_uris[cid] = uri;
+
+    return uri;
+  }
+
+  void ThreadView::log_request_stats () {
+    if (request_stats.requests > 0) {
+      LOG (debug) << "tv: requests: " << request_stats.requests
+                  << ", denied: " << request_stats.denied
+                  << " (" << request_stats.cached << " cached)"
+                  << ", time: " << request_stats.time.count () << " us"
+                  << " (" << (request_stats.time.count () / request_stats.requests) << " us per request)";
+    }
+
+    request_stats = RequestStats ();
   }
 
   void ThreadView::reload_images () {
@@ -315,7 +418,7 @@ namespace Astroid {
             webkit_dom_element_set_attribute (ine, "src", src, (err = NULL, &err));
           }
 
-          // TODO: cid type images or attachment references are not loaded
+          /* cid type images are resolved again in resource_request_starting */
         }
 
         g_object_unref (in);
@@ -602,6 +705,7 @@ namespace Astroid {
 
           message_render_tags (_m, div_message);
           message_update_css_tags (_m, div_message);
+          invalidate_geometry ();
 
           g_object_unref (div_message);
           g_object_unref (d);
@@ -699,6 +803,44 @@ namespace Astroid {
     }
   }
 
+  void ThreadView::set_avatar (refptr<Message> /* m */, WebKitDOMHTMLElement * div_message, ustring uri) {
+    GError * err;
+
+    WebKitDOMHTMLImageElement * av = WEBKIT_DOM_HTML_IMAGE_ELEMENT (
+        DomUtils::select (
+        WEBKIT_DOM_NODE (div_message),
+        ".avatar"));
+
+    webkit_dom_element_set_attribute (WEBKIT_DOM_ELEMENT (av), "src",
+        uri.c_str (),
+        (err = NULL, &err));
+
+    g_object_unref (av);
+  }
+
+  void ThreadView::on_avatar_ready (ustring email, ustring uri) {
+    auto w = avatar_waiting.find (email);
+    if (w == avatar_waiting.end ()) return;
+
+    if (!uri.empty ()) {
+      WebKitDOMDocument * d = webkit_web_view_get_dom_document (webview);
+
+      for (auto &m : w->second) {
+        ustring mid = "message_" + m->mid;
+        WebKitDOMElement * e = webkit_dom_document_get_element_by_id (d, mid.c_str());
+
+        if (e != NULL) {
+          set_avatar (m, WEBKIT_DOM_HTML_ELEMENT (e), uri);
+          g_object_unref (e);
+        }
+      }
+
+      g_object_unref (d);
+    }
+
+    avatar_waiting.erase (w);
+  }
+
   /* end message loading  */
 
   /* rendering  */
@@ -716,6 +858,14 @@ namespace Astroid {
         astroid->standard_paths ().config_dir.c_str(),
         UstringUtils::random_alphanumeric (120));
 
+    /* parts of the previous thread are no longer needed */
+    PartScheme::remove (part_uri);
+    part_uri = PartScheme::make_prefix ();
+    cid_uris.clear ();
+
+    log_request_stats ();
+    build_allowed_uris ();
+
     webkit_web_view_load_html_string (webview, theme.thread_view_html.c_str (), home_uri.c_str());
     ready     = false;
   }
@@ -730,12 +880,21 @@ namespace Astroid {
     /* set message state vector */
     state.clear ();
     focused_message.clear ();
+    invalidate_geometry ();
+
+    search_indexer.disconnect ();
+    search_index.clear ();
+
+    avatar_waiting.clear ();
+
+    unsigned int position = 0;
 
     for_each (mthread->messages.begin(),
               mthread->messages.end(),
               [&](refptr<Message> m) {
                 add_message (m);
                 state.insert (std::pair<refptr<Message>, MessageState> (m, MessageState ()));
+                state[m].position = position++;
 
                 if (!edit_mode) {
                   m->signal_message_changed ().connect (
@@ -768,6 +927,13 @@ namespace Astroid {
 
     emit_ready ();
 
+    /* build search index when idle */
+    if (!edit_mode) {
+      search_indexer = Glib::signal_idle ().connect (
+          sigc::mem_fun (this, &ThreadView::search_index_step),
+          Glib::PRIORITY_LOW);
+    }
+
     if (sc) {
       if (!unread_setup) {
         /* there's potentially a small chance that scroll_to_message gets an
@@ -789,6 +955,8 @@ namespace Astroid {
     for (auto &m : mthread->messages) {
       update_indent_state (m);
     }
+
+    invalidate_geometry ();
   }
 
   void ThreadView::update_indent_state (refptr<Message> m) {
@@ -939,31 +1107,48 @@ namespace Astroid {
 
     /* avatar */
     {
-      ustring uri = "";
-      auto se = Address(m->sender);
+      ustring email = Address(m->sender).email ().lowercase ();
+      ustring uri;
+
+      switch (astroid->avatars->lookup (email, uri)) {
+        case AvatarCache::Found:
+          set_avatar (m, div_message, uri);
+          break;
+
+        case AvatarCache::Missing:
+          break;
+
+        case AvatarCache::Pending:
+          avatar_waiting[email].push_back (m);
+          break;
+
+        case AvatarCache::Unknown:
+          {
+            /* resolve each sender once per thread */
+            if (avatar_waiting.count (email)) {
+              avatar_waiting[email].push_back (m);
+              break;
+            }
+
+            ustring source = "";
 # ifdef DISABLE_PLUGINS
-      if (false) {
+            if (false) {
 # else
-      if (plugins->get_avatar_uri (se.email (), Gravatar::DefaultStr[Gravatar::Default::RETRO], 48, m, uri)) {
+            if (plugins->get_avatar_uri (email, Gravatar::DefaultStr[Gravatar::Default::RETRO], AvatarCache::SIZE, m, source)) {
 # endif
-        ; // all fine, use plugins avatar
-      } else {
-        if (enable_gravatar) {
-          uri = Gravatar::get_image_uri (se.email (),Gravatar::Default::RETRO , 48);
-        }
-      }
-
-      if (!uri.empty ()) {
-        WebKitDOMHTMLImageElement * av = WEBKIT_DOM_HTML_IMAGE_ELEMENT (
-            DomUtils::select (
-            WEBKIT_DOM_NODE (div_message),
-            ".avatar"));
-
-        webkit_dom_element_set_attribute (WEBKIT_DOM_ELEMENT (av), "src",
-            uri.c_str (),
-            (err = NULL, &err));
+              ; // all fine, use plugins avatar
+            } else {
+              if (enable_gravatar) {
+                source = Gravatar::get_image_uri (email, Gravatar::Default::RETRO, AvatarCache::SIZE);
+              }
+            }
 
-        g_object_unref (av);
+            if (!source.empty () || astroid->avatars->has_local_directory ()) {
+              avatar_waiting[email].push_back (m);
+              astroid->avatars->request (email, source);
+            }
+          }
+          break;
       }
     }
 
@@ -1476,6 +1661,7 @@ namespace Astroid {
         state[message].elements.end());
 
     state[message].current_element = 0;
+    invalidate_geometry ();
 
     if (c->viewable) {
       create_body_part (message, c, span_body);
@@ -1569,6 +1755,8 @@ namespace Astroid {
     webkit_dom_dom_token_list_add (class_list, "show",
         (err = NULL, &err));
 
+    invalidate_geometry ();
+
     g_object_unref (class_list);
     g_object_unref (warning);
     g_object_unref (e);
@@ -1595,6 +1783,8 @@ namespace Astroid {
     webkit_dom_dom_token_list_remove (class_list, "show",
         (err = NULL, &err));
 
+    invalidate_geometry ();
+
     g_object_unref (class_list);
     g_object_unref (warning);
     g_object_unref (e);
@@ -1627,6 +1817,8 @@ namespace Astroid {
     webkit_dom_dom_token_list_add (class_list, "show",
         (err = NULL, &err));
 
+    invalidate_geometry ();
+
     g_object_unref (class_list);
     g_object_unref (info);
     g_object_unref (e);
@@ -1656,6 +1848,8 @@ namespace Astroid {
     webkit_dom_dom_token_list_remove (class_list, "show",
         (err = NULL, &err));
 
+    invalidate_geometry ();
+
     g_object_unref (class_list);
     g_object_unref (info);
     g_object_unref (e);
@@ -2009,9 +2203,14 @@ namespace Astroid {
 
     }
 
+    /* served through the part scheme, which takes ownership of content */
+    ustring src = PartScheme::add (part_uri,
+        ustring::compose ("%1/preview", c->id), image_content_type,
+        g_bytes_new_take (content, content_size));
+
     GError * err = NULL;
     webkit_dom_element_set_attribute (WEBKIT_DOM_ELEMENT (img), "src",
-        DomUtils::assemble_data_uri (image_content_type, content, content_size).c_str(), &err);
+        src.c_str(), &err);
 
   }
   /* attachments end  */
@@ -3466,6 +3665,10 @@ namespace Astroid {
   /* focus handling  */
 
   void ThreadView::on_scroll_vadjustment_changed () {
+    /* the bounds of the scrolled window change when the content is
+     * re-laid out: images have been loaded, the window resized, etc. */
+    invalidate_geometry ();
+
     if (in_scroll) {
       in_scroll = false;
       LOG (debug) << "tv: re-doing scroll.";
@@ -3503,8 +3706,6 @@ namespace Astroid {
 
     if (edit_mode) return;
 
-    WebKitDOMDocument * d = webkit_web_view_get_dom_document (webview);
-
     auto adj = scroll.get_vadjustment ();
     double scrolled = adj->get_value ();
     double height   = adj->get_page_size (); // 0 when there is
@@ -3513,31 +3714,19 @@ namespace Astroid {
 
     double center = scrolled + (height / 2);
 
-    for (auto &m : mthread->messages) {
-      ustring mid = "message_" + m->mid;
-
-      WebKitDOMElement * e = webkit_dom_document_get_element_by_id (d, mid.c_str());
-
-      double clientY = webkit_dom_element_get_offset_top (e);
-      double clientH = webkit_dom_element_get_client_height (e);
-
-      // LOG (debug) << "y = " << clientY;
-      // LOG (debug) << "h = " << clientH;
-
-      g_object_unref (e);
+    update_geometry ();
 
-      if ((clientY < center) && ((clientY + clientH) > center))
-      {
-        // LOG (debug) << "message: " << m->date() << " now in view.";
-
-        focused_message = m;
+    /* first message with its bottom below the center */
+    auto g = upper_bound (message_geometry.begin (), message_geometry.end (),
+        center,
+        [](double c, const MessageGeometry & mg) {
+          return c < mg.bottom;
+        });
 
-        break;
-      }
+    if (g != message_geometry.end () && g->top < center) {
+      focused_message = mthread->messages[g - message_geometry.begin ()];
     }
 
-    g_object_unref (d);
-
     update_focus_status ();
   }
 
@@ -3548,12 +3737,6 @@ namespace Astroid {
       return;
     }
 
-    /* loop through elements from the top and test whether the top
-     * of it is within the view
-     */
-
-    WebKitDOMDocument * d = webkit_web_view_get_dom_document (webview);
-
     auto adj = scroll.get_vadjustment ();
     double scrolled = adj->get_value ();
     double height   = adj->get_page_size (); // 0 when there is
@@ -3561,9 +3744,6 @@ namespace Astroid {
 
     //LOG (debug) << "scrolled = " << scrolled << ", height = " << height;
 
-    /* check currently focused message */
-    bool take_next = false;
-
     /* take first */
     if (!focused_message) {
       //LOG (debug) << "tv: u_f_t_v: none focused, take first initially.";
@@ -3571,89 +3751,96 @@ namespace Astroid {
       update_focus_status ();
     }
 
-    /* check if focused message is still visible */
-    ustring mid = "message_" + focused_message->mid;
-
-    WebKitDOMElement * e = webkit_dom_document_get_element_by_id (d, mid.c_str());
-
-    double clientY = webkit_dom_element_get_offset_top (e);
-    double clientH = webkit_dom_element_get_client_height (e);
+    // height = 0 if there is no paging: all messages are in view.
+    if (height == 0) return;
 
-    g_object_unref (e);
+    update_geometry ();
 
-    //LOG (debug) << "y = " << clientY;
-    //LOG (debug) << "h = " << clientH;
+    /* check if focused message is still visible */
+    MessageState & fs = state[focused_message];
 
-    // height = 0 if there is no paging: all messages are in view.
-    if ((height == 0) || ( (clientY <= (scrolled + height)) && ((clientY + clientH) >= scrolled) )) {
+    if ((fs.top <= (scrolled + height)) && ((fs.top + fs.height) >= scrolled)) {
       //LOG (debug) << "message: " << focused_message->date() << " still in view.";
-    } else {
-      //LOG (debug) << "message: " << focused_message->date() << " out of view.";
-      take_next = true;
+      return;
     }
 
+    /* messages are laid out top to bottom, so the ones in view are the
+     * range between the first message with its bottom below the top of
+     * the view and the first message with its top below the bottom of
+     * the view. */
+    auto first = lower_bound (message_geometry.begin (), message_geometry.end (),
+        scrolled,
+        [](const MessageGeometry & mg, double s) {
+          return mg.bottom < s;
+        });
 
-    /* find first message that is in view and update
-     * focused status */
-    if (take_next) {
-      int focused_position = find (
-          mthread->messages.begin (),
-          mthread->messages.end (),
-          focused_message) - mthread->messages.begin ();
-      int cur_position = 0;
+    auto last = upper_bound (first, message_geometry.end (),
+        scrolled + height,
+        [](double e, const MessageGeometry & mg) {
+          return e < mg.top;
+        });
 
-      bool found = false;
-      bool redo_focus_tags = false;
+    if (first == last) return; // nothing in view
 
-      for (auto &m : mthread->messages) {
-        ustring mid = "message_" + m->mid;
+    /* take the last message in view if the focused message is now below
+     * the view, otherwise take the first that is in view. */
+    unsigned int position;
+    if (fs.position >= static_cast<unsigned int> (last - message_geometry.begin ())) {
+      position = (last - message_geometry.begin ()) - 1;
+    } else {
+      position = first - message_geometry.begin ();
+    }
 
-        WebKitDOMElement * e = webkit_dom_document_get_element_by_id (d, mid.c_str());
+    if (mthread->messages[position] != focused_message) {
+      focused_message = mthread->messages[position];
+      update_focus_status ();
+    }
+  }
 
-        double clientY = webkit_dom_element_get_offset_top (e);
-        double clientH = webkit_dom_element_get_client_height (e);
+  void ThreadView::invalidate_geometry () {
+    geometry_valid = false;
+  }
 
-        // LOG (debug) << "y = " << clientY;
-        // LOG (debug) << "h = " << clientH;
+  void ThreadView::update_geometry () {
+    /* read the offsets of all messages and their elements from the DOM,
+     * only done when the layout has changed since the last time. */
+    if (geometry_valid) return;
 
-        WebKitDOMDOMTokenList * class_list =
-          webkit_dom_element_get_class_list (e);
+    WebKitDOMDocument * d = webkit_web_view_get_dom_document (webview);
 
-        GError * gerr = NULL;
+    message_geometry.clear ();
 
-        /* search for the last message that is currently in view
-         * if the focused message is now below / beyond the view.
-         * otherwise, take first that is in view now. */
+    for (auto &m : mthread->messages) {
+      MessageState & s = state[m];
 
-        if ((!found || cur_position < focused_position) &&
-            ( (height == 0) || ((clientY <= (scrolled + height)) && ((clientY + clientH) >= scrolled)) ))
-        {
-          // LOG (debug) << "message: " << m->date() << " now in view.";
+      ustring mid = "message_" + m->mid;
+      WebKitDOMElement * e = webkit_dom_document_get_element_by_id (d, mid.c_str());
 
-          if (found) redo_focus_tags = true;
-          found = true;
-          focused_message = m;
+      if (e != NULL) {
+        s.top    = webkit_dom_element_get_offset_top (e);
+        s.height = webkit_dom_element_get_client_height (e);
+        g_object_unref (e);
+      }
 
-          /* set class  */
-          webkit_dom_dom_token_list_add (class_list, "focused",
-              (gerr = NULL, &gerr));
+      message_geometry.push_back ({ s.top, s.top + s.height });
 
-        } else {
-          /* reset class */
-          webkit_dom_dom_token_list_remove (class_list, "focused",
-              (gerr = NULL, &gerr));
-        }
+      /* the first element is the message itself */
+      for (unsigned int eno = 1; eno < s.elements.size (); eno++) {
+        MessageState::Element & el = s.elements[eno];
 
-        g_object_unref (class_list);
-        g_object_unref (e);
+        WebKitDOMElement * ee = webkit_dom_document_get_element_by_id (d, el.element_id().c_str());
 
-        cur_position++;
+        if (ee != NULL) {
+          el.top    = webkit_dom_element_get_offset_top (ee);
+          el.height = webkit_dom_element_get_client_height (ee);
+          g_object_unref (ee);
+        }
       }
+    }
 
-      g_object_unref (d);
+    g_object_unref (d);
 
-      if (redo_focus_tags) update_focus_status ();
-    }
+    geometry_valid = true;
   }
 
   void ThreadView::update_focus_status () {
@@ -3785,9 +3972,9 @@ namespace Astroid {
       if (s->current_element < (s->elements.size()-1)) {
         /* check if the next element is in full view */
 
-        MessageState::Element * next_e = &(s->elements[s->current_element + 1]);
+        update_geometry ();
 
-        WebKitDOMDocument * d = webkit_web_view_get_dom_document (webview);
+        MessageState::Element * next_e = &(s->elements[s->current_element + 1]);
 
         auto adj = scroll.get_vadjustment ();
 
@@ -3796,17 +3983,12 @@ namespace Astroid {
         bool change_focus = force_change;
 
         if (!force_change) {
-          WebKitDOMElement * e = webkit_dom_document_get_element_by_id (d, eid.c_str());
-
           double scrolled = adj->get_value ();
           double height   = adj->get_page_size (); // 0 when there is
                                                    // no paging.
 
-          double clientY = webkit_dom_element_get_offset_top (e);
-          double clientH = webkit_dom_element_get_client_height (e);
-
-          g_object_unref (e);
-          g_object_unref (d);
+          double clientY = next_e->top;
+          double clientH = next_e->height;
 
           if (height > 0) {
             if (  (clientY >= scrolled) &&
@@ -3870,23 +4052,18 @@ namespace Astroid {
 
         if (!force_change) {
           if (next_e->type != MessageState::ElementType::Empty) {
-            WebKitDOMDocument * d = webkit_web_view_get_dom_document (webview);
+            update_geometry ();
 
             auto adj = scroll.get_vadjustment ();
 
             eid = next_e->element_id ();
 
-            WebKitDOMElement * e = webkit_dom_document_get_element_by_id (d, eid.c_str());
-
             double scrolled = adj->get_value ();
             double height   = adj->get_page_size (); // 0 when there is
                                                      // no paging.
 
-            double clientY = webkit_dom_element_get_offset_top (e);
-            double clientH = webkit_dom_element_get_client_height (e);
-
-            g_object_unref (e);
-            g_object_unref (d);
+            double clientY = next_e->top;
+            double clientH = next_e->height;
 
             if (height > 0) {
               if (  (clientY >= scrolled) &&
@@ -4134,6 +4311,8 @@ namespace Astroid {
       if (t == ToggleToggle || t == ToggleShow) {
         webkit_dom_dom_token_list_remove (class_list, "hide",
             (gerr = NULL, &gerr));
+
+        invalidate_geometry ();
       }
 
     } else {
@@ -4143,6 +4322,8 @@ namespace Astroid {
       if (t == ToggleToggle || t == ToggleHide) {
         webkit_dom_dom_token_list_add (class_list, "hide",
             (gerr = NULL, &gerr));
+
+        invalidate_geometry ();
       }
     }
 
@@ -4330,14 +4511,19 @@ namespace Astroid {
 
     if (!k.empty ()) {
 
-      /* expand all messages, these should be closed - except the focused one
-       * when a search is cancelled */
-      for (auto m : mthread->messages) {
+      /* only expand the messages that contain the text, these should be
+       * closed - except the focused one - when a search is cancelled. when
+       * the index has no hits the expanded messages are still searched,
+       * the index does not have the rendered headers or html parts. */
+      vector<refptr<Message>> matches = search_matches (k);
+
+      LOG (debug) << "tv: searching for: " << k << ", in: " << matches.size () << " messages.";
+
+      for (auto m : matches) {
         state[m].search_expanded = is_hidden (m);
         toggle_hidden (m, ToggleShow);
       }
 
-      LOG (debug) << "tv: searching for: " << k;
       int n = webkit_web_view_mark_text_matches (webview, k.c_str (), false, 0);
 
       LOG (debug) << "tv: search, found: " << n << " matches.";
@@ -4352,8 +4538,10 @@ namespace Astroid {
         next_search_match ();
 
       } else {
+        LOG (info) << "tv: search: no matches for: " << k;
+
         /* un-expand messages again */
-        for (auto m : mthread->messages) {
+        for (auto m : matches) {
           if (state[m].search_expanded) toggle_hidden (m, ToggleHide);
           state[m].search_expanded = false;
         }
@@ -4364,16 +4552,11 @@ namespace Astroid {
 
   void ThreadView::next_search_match () {
     if (!in_search) return;
-    /* there does not seem to be a way to figure out which message currently
-     * contains the selected matched text, but when there is a scroll event
-     * the match is centered.
-     *
-     * the focusing is handled in on_scroll_vadjustment...
-     *
-     */
 
     in_search_match = true;
     webkit_web_view_search_text (webview, search_q.c_str (), false, true, true);
+
+    if (focus_search_selection ()) in_search_match = false;
   }
 
   void ThreadView::prev_search_match () {
@@ -4381,6 +4564,100 @@ namespace Astroid {
 
     in_search_match = true;
     webkit_web_view_search_text (webview, search_q.c_str (), false, false, true);
+
+    if (focus_search_selection ()) in_search_match = false;
+  }
+
+  bool ThreadView::focus_search_selection () {
+    /* focus the message containing the currently selected match. if this
+     * fails the focus is updated in on_scroll_vadjustment_changed when the
+     * match is centered. */
+    WebKitDOMDocument  * d   = webkit_web_view_get_dom_document (webview);
+    WebKitDOMDOMWindow * w   = webkit_dom_document_get_default_view (d);
+    WebKitDOMDOMSelection * sel = webkit_dom_dom_window_get_selection (w);
+
+    WebKitDOMNode * n = NULL;
+    if (sel != NULL) n = webkit_dom_dom_selection_get_anchor_node (sel);
+
+    ustring div_id;
+
+    while (n != NULL) {
+      if (WEBKIT_DOM_IS_ELEMENT (n)) {
+        gchar * id = webkit_dom_element_get_attribute (WEBKIT_DOM_ELEMENT (n), "id");
+        if (id != NULL) {
+          ustring i (id);
+          g_free (id);
+
+          if (i.find ("message_") == 0) {
+            div_id = i;
+            g_object_unref (n);
+            break;
+          }
+        }
+      }
+
+      WebKitDOMNode * p = webkit_dom_node_get_parent_node (n);
+      g_object_unref (n);
+      n = p;
+    }
+
+    if (sel != NULL) g_object_unref (sel);
+    g_object_unref (w);
+    g_object_unref (d);
+
+    if (div_id.empty ()) return false;
+
+    for (auto &m : mthread->messages) {
+      if (("message_" + m->mid) == div_id) {
+        focused_message = m;
+        update_focus_status ();
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  bool ThreadView::search_index_step () {
+    /* index the next message, returns false when done */
+    if (!mthread || search_index.size () >= mthread->messages.size ()) {
+      return false;
+    }
+
+    refptr<Message> m = mthread->messages[search_index.size ()];
+
+    ustring txt = m->sender + "\n" + m->subject + "\n";
+    if (!m->missing_content) {
+      txt += m->viewable_text (false, true);
+    }
+
+    search_index.push_back (txt.casefold ());
+
+    if (search_index.size () == mthread->messages.size ()) {
+      LOG (debug) << "tv: search index ready (" << search_index.size () << " messages).";
+      return false;
+    }
+
+    return true;
+  }
+
+  vector<refptr<Message>> ThreadView::search_matches (ustring k) {
+    /* finish the index if the search comes before it is done */
+    if (search_index.size () < mthread->messages.size ()) {
+      search_indexer.disconnect ();
+      while (search_index_step ()) ;
+    }
+
+    ustring kf = k.casefold ();
+    vector<refptr<Message>> matches;
+
+    for (unsigned int i = 0; i < search_index.size (); i++) {
+      if (search_index[i].find (kf) != ustring::npos) {
+        matches.push_back (mthread->messages[i]);
+      }
+    }
+
+    return matches;
   }
 
   /*  */
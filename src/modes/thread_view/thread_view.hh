@@ -2,6 +2,7 @@
 
 # include <atomic>
 # include <map>
+# include <set>
 # include <vector>
 # include <string>
 # include <chrono>
@@ -71,6 +72,11 @@ namespace Astroid {
 
       /* resources */
       ustring home_uri;           // relative url for requests
+      ustring part_uri;           // prefix of parts served through PartScheme
+
+      /* inline parts referenced by content id, resolved to part uris */
+      std::map<ustring, ustring> cid_uris;
+      ustring get_cid_uri (ustring cid);
 
       bool    expand_flagged;
       bool    enable_code_prettify;
@@ -105,6 +111,21 @@ namespace Astroid {
       ustring scroll_arg;
       bool    _scroll_when_visible;
 
+      /* geometry of messages and elements is cached so that focus tracking
+       * does not query the DOM on every scroll event. the cache is only
+       * re-read after layout changes (expand / collapse, image loads or
+       * resizes). */
+      struct MessageGeometry {
+        double top;
+        double bottom;
+      };
+
+      std::vector<MessageGeometry> message_geometry; // ordered as mthread->messages
+      bool geometry_valid = false;
+
+      void invalidate_geometry ();
+      void update_geometry ();
+
       void update_focus_to_view ();
       void update_focus_to_center ();
       void update_focus_status ();
@@ -157,6 +178,10 @@ namespace Astroid {
               ustring     element_id ();
 
               bool operator== ( const Element & other ) const;
+
+              /* cached geometry, see update_geometry () */
+              double top    = 0;
+              double height = 0;
           };
 
           /* ordered list of elements, must be listed in order of
@@ -168,6 +193,11 @@ namespace Astroid {
           std::vector<Element> elements;
           unsigned int    current_element;
           Element * get_current_element ();
+
+          /* position in thread and cached geometry of message */
+          unsigned int position = 0;
+          double       top      = 0;
+          double       height   = 0;
       };
 
       std::map<refptr<Message>, MessageState> state;
@@ -222,6 +252,13 @@ namespace Astroid {
       void message_render_tags (refptr<Message>, WebKitDOMElement * div_message);
       void message_update_css_tags (refptr<Message>, WebKitDOMElement * div_message);
 
+      /* avatars are resolved by the avatar cache, messages waiting for the
+       * avatar of their sender are kept here so that each sender is only
+       * resolved once. */
+      std::map<ustring, std::vector<refptr<Message>>> avatar_waiting;
+      void set_avatar (refptr<Message>, WebKitDOMHTMLElement *, ustring);
+      void on_avatar_ready (ustring, ustring);
+
       bool open_html_part_external;
       void display_part (refptr<Message>, refptr<Chunk>, MessageState::Element);
 
@@ -278,6 +315,23 @@ namespace Astroid {
         WebKitNetworkRequest  *request,
         WebKitNetworkResponse *response);
 
+      /* allowed uri prefixes, sorted and without redundant entries */
+      std::vector<std::string> allowed_uris;
+      void build_allowed_uris ();
+      bool is_allowed_uri (const std::string &);
+
+      /* requests denied since the last render */
+      std::set<std::string> denied_uris;
+
+      struct RequestStats {
+        unsigned int requests = 0;
+        unsigned int denied   = 0;
+        unsigned int cached   = 0;
+        std::chrono::microseconds time = std::chrono::microseconds (0);
+      } request_stats;
+
+      void log_request_stats ();
+
 
       void grab_focus ();
 
@@ -306,6 +360,15 @@ namespace Astroid {
       bool in_search_match = false;
       ustring search_q = "";
 
+      /* search index: case folded plain text of each message (ordered as
+       * mthread->messages), built in idle time after the thread has been
+       * rendered so that only matching messages need to be expanded. */
+      std::vector<ustring> search_index;
+      sigc::connection search_indexer;
+      bool search_index_step ();
+      std::vector<refptr<Message>> search_matches (ustring);
+      bool focus_search_selection ();
+
     public:
       /* the tv is ready */
       typedef sigc::signal <void> type_signal_ready;
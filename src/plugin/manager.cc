@@ -9,6 +9,7 @@
 # include "astroid.hh"
 # include "config.hh"
 # include "build_config.hh"
+# include "utils/utils.hh"
 # include "utils/vector_utils.hh"
 # include "message_thread.hh"
 
@@ -127,6 +128,8 @@ namespace Astroid {
         LOG (error) << "plugins: failed loading: " << peas_plugin_info_get_name (p);
       }
     }
+
+    Utils::clear_tag_colors ();
   }
 
   /* ********************
@@ -165,10 +168,14 @@ namespace Astroid {
     }
 
     active = true;
+
+    /* plugins may provide tag colors */
+    Utils::clear_tag_colors ();
   }
 
   void PluginManager::AstroidExtension::deactivate () {
     active = false;
+    Utils::clear_tag_colors ();
 
     for ( PeasPluginInfo *p : astroid->plugin_manager->astroid_plugins) {
 
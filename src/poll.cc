@@ -1,15 +1,17 @@
 # include <mutex>
 # include <chrono>
-# include <sys/wait.h>
+# include <algorithm>
 
 # include <boost/filesystem.hpp>
-# include <glibmm/spawn.h>
+# include <glibmm/shell.h>
 
 # include "astroid.hh"
 # include "poll.hh"
 # include "db.hh"
 # include "config.hh"
 # include "actions/action_manager.hh"
+# include "indexer.hh"
+# include "poll_source.hh"
 # include "utils/vector_utils.hh"
 
 
@@ -25,15 +27,68 @@ namespace Astroid {
 
     poll_state = false;
 
-    poll_interval = astroid->config ().get<int> ("poll.interval");
-    full_refresh  = astroid->config ().get<bool> ("poll.always_full_refresh");
+    const ptree& config = astroid->config ("poll");
+
+    poll_interval = config.get<int> ("interval");
+    full_refresh  = config.get<bool> ("always_full_refresh");
+    max_running   = max (config.get<int> ("max_running"), 1);
+    backoff_max   = config.get<int> ("backoff_max");
     LOG (debug) << "poll: interval: " << poll_interval;
 
+    int timeout = config.get<int> ("timeout");
+
+    /* the poll sources, or the poll script */
+    auto srcs = config.get_child_optional ("sources");
+
+    if (srcs) {
+      for (auto & kv : *srcs) {
+        string cmd = kv.second.get<string> ("command", "");
+        vector<string> argv;
+
+        try {
+          if (!cmd.empty ()) argv = Glib::shell_parse_argv (cmd);
+        } catch (Glib::ShellError &ex) {
+          LOG (error) << "poll: " << kv.first << ": could not parse command: " << ex.what ();
+        }
+
+        if (argv.empty ()) {
+          LOG (error) << "poll: " << kv.first << ": no command, skipping.";
+          continue;
+        }
+
+        /* scripts may be placed in the config dir */
+        path script = astroid->standard_paths ().config_dir / path (argv[0]);
+        if (!path (argv[0]).is_absolute () && is_regular_file (script)) {
+          argv[0] = script.string ();
+        }
+
+        PollSource * s = new PollSource (kv.first, argv,
+            kv.second.get<int> ("interval", poll_interval),
+            kv.second.get<int> ("timeout", timeout));
+
+        sources.push_back (s);
+      }
+    }
+
+    if (sources.empty ()) {
+      path poll_script_uri = astroid->standard_paths().config_dir / path(poll_script);
+      sources.push_back (new PollSource ("poll", { poll_script_uri.string () }, poll_interval, timeout));
+    }
+
+    for (auto s : sources) {
+      s->signal_done ().connect (sigc::mem_fun (this, &Poll::on_source_done));
+      s->signal_output ().connect (sigc::mem_fun (this, &Poll::on_source_output));
+    }
+
+    LOG (info) << "poll: " << sources.size () << " sources, polling at most " << max_running << " at the time.";
+
     // check every 1 seconds if periodic poll has changed
     Glib::signal_timeout ().connect (
         sigc::mem_fun (this, &Poll::periodic_polling), 1000);
 
-    if (poll_interval <= 0) auto_polling_enabled = false;
+    if (none_of (sources.begin (), sources.end (), [] (PollSource * s) { return s->interval > 0; })) {
+      auto_polling_enabled = false;
+    }
 
     if (auto_polling_enabled) {
       // do initial poll
@@ -44,14 +99,183 @@ namespace Astroid {
     }
 
     d_poll_state.connect (sigc::mem_fun (this, &Poll::poll_state_dispatch));
-    if (!full_refresh) {
-      d_refresh.connect (sigc::mem_fun (this, &Poll::refresh_threads));
-    } else {
-      d_refresh.connect (sigc::mem_fun (this, &Poll::refresh_full));
+
+    bool use_indexer = astroid->config ().get<bool> ("poll.indexer");
+
+    if (astroid->config ().get<bool> ("poll.watch")) {
+      watch_delay = (int) (astroid->config ().get<double> ("poll.watch_delay") * 1000);
+
+      /* the indexer handles new mail itself */
+      setup_watch (astroid->config ().get<bool> ("poll.watch_maildir") && !use_indexer);
+    }
+
+    if (use_indexer) {
+      indexer = new Indexer ();
+      indexer->signal_indexed ().connect (sigc::mem_fun (this, &Poll::on_indexed));
     }
   }
 
   void Poll::close () {
+    batch_refresh_c.disconnect ();
+
+    for (auto s : sources) {
+      s->close ();
+      delete s;
+    }
+
+    sources.clear ();
+
+    if (indexer) {
+      indexer->close ();
+      delete indexer;
+      indexer = NULL;
+    }
+
+    watch_refresh_c.disconnect ();
+    watch_poll_c.disconnect ();
+
+    if (db_monitor) db_monitor->cancel ();
+    for (auto & m : maildir_monitors) m->cancel ();
+
+    db_monitor.clear ();
+    maildir_monitors.clear ();
+  }
+
+  /* watching */
+  void Poll::setup_watch (bool watch_maildir) {
+    path xapian = Db::path_db / path (".notmuch") / path ("xapian");
+
+    if (!is_directory (xapian)) {
+      LOG (warn) << "poll: watch: database directory not found, not watching: " << xapian.c_str ();
+      return;
+    }
+
+    {
+      Db db (Db::DbMode::DATABASE_READ_ONLY);
+      watch_revision = db.get_revision ();
+    }
+
+    try {
+      db_monitor = Gio::File::create_for_path (xapian.c_str ())->monitor_directory ();
+      db_monitor->signal_changed ().connect (sigc::mem_fun (this, &Poll::on_db_changed));
+
+    } catch (Glib::Error &ex) {
+      LOG (error) << "poll: watch: could not watch database: " << ex.what ();
+      return;
+    }
+
+    LOG (info) << "poll: watch: watching database: " << xapian.c_str ();
+
+    if (!watch_maildir) return;
+
+    for (auto & f : Indexer::maildir_folders (Db::path_db, false)) {
+      try {
+        auto m = Gio::File::create_for_path (f.c_str ())->monitor_directory ();
+        m->signal_changed ().connect (sigc::mem_fun (this, &Poll::on_maildir_changed));
+        maildir_monitors.push_back (m);
+
+      } catch (Glib::Error &ex) {
+        LOG (error) << "poll: watch: could not watch: " << f.c_str () << ": " << ex.what ();
+      }
+    }
+
+    LOG (info) << "poll: watch: watching " << maildir_monitors.size () << " maildirs.";
+  }
+
+  void Poll::on_db_changed (
+      const refptr<Gio::File> &,
+      const refptr<Gio::File> &,
+      Gio::FileMonitorEvent)
+  {
+    /* collect the events of one commit */
+    if (!watch_refresh_c.connected ()) {
+      watch_refresh_c = Glib::signal_timeout ().connect (
+          sigc::mem_fun (this, &Poll::on_watch_refresh), watch_delay);
+    }
+  }
+
+  bool Poll::on_watch_refresh () {
+    if (external_polling || polling) {
+      /* the running poll refreshes when it is done, from the changes
+       * that have not been refreshed yet */
+      LOG (debug) << "poll: watch: poll in progress, not refreshing.";
+      before_poll_revision = min (before_poll_revision, Db::skip_written (watch_revision));
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lk (m_dopoll);
+
+    unsigned long revnow;
+
+    {
+      Db db (Db::DbMode::DATABASE_READ_ONLY);
+      revnow = db.get_revision ();
+    }
+
+    /* the changes written by astroid have been signalled by the action
+     * worker or the indexer */
+    unsigned long from = Db::skip_written (watch_revision);
+
+    if (revnow > from) {
+      LOG (info) << "poll: watch: database changed, refreshing threads since: " << from;
+
+      before_poll_revision = from;
+
+      if (full_refresh) {
+        refresh_full ();
+        watch_revision = revnow;
+      } else {
+        refresh_threads ();
+      }
+
+    } else if (from > watch_revision) {
+      LOG (debug) << "poll: watch: only changes by astroid, not refreshing.";
+      watch_revision = from;
+    }
+
+    return false;
+  }
+
+  void Poll::on_maildir_changed (
+      const refptr<Gio::File> &,
+      const refptr<Gio::File> &,
+      Gio::FileMonitorEvent event_type)
+  {
+    /* delivered mail is moved in from tmp/, which is reported as created */
+    if (event_type != Gio::FileMonitorEvent::FILE_MONITOR_EVENT_CREATED) return;
+
+    if (!watch_poll_c.connected ()) {
+      watch_poll_c = Glib::signal_timeout ().connect (
+          sigc::mem_fun (this, &Poll::on_watch_poll), watch_delay);
+    }
+  }
+
+  void Poll::on_indexed (unsigned long before) {
+    if (external_polling || polling) {
+      /* the running poll refreshes when it is done */
+      LOG (debug) << "poll: indexed: poll in progress, not refreshing.";
+      if (before < before_poll_revision) before_poll_revision = before;
+      return;
+    }
+
+    std::lock_guard<std::mutex> lk (m_dopoll);
+
+    LOG (debug) << "poll: indexed: refreshing threads since: " << before;
+
+    before_poll_revision = before;
+
+    if (full_refresh) {
+      refresh_full ();
+    } else {
+      refresh_threads ();
+    }
+  }
+
+  bool Poll::on_watch_poll () {
+    LOG (info) << "poll: watch: new mail in maildir, polling..";
+    poll ();
+
+    return false;
   }
 
   void Poll::start_polling () {
@@ -64,7 +288,7 @@ namespace Astroid {
     }
 
     LOG (info) << "poll: external polling started..";
-    if (m_dopoll.try_lock ()) {
+    if (!polling && m_dopoll.try_lock ()) {
 
       external_polling = true;
       set_poll_state (true);
@@ -96,12 +320,19 @@ namespace Astroid {
   }
 
   bool Poll::periodic_polling () {
-    if (auto_polling_enabled) {
-      chrono::duration<double> elapsed = chrono::steady_clock::now() - last_poll;
+    auto now = chrono::steady_clock::now ();
+
+    for (auto s : sources) {
+      if (s->running ()) {
+        s->check_timeout ();
+        continue;
+      }
 
-      if (elapsed.count () >= poll_interval) {
-        LOG (info) << "poll: periodic poll..";
-        poll ();
+      bool due = auto_polling_enabled && s->interval > 0 && now >= s->next_poll;
+
+      if ((due || s->requested) && running < max_running) {
+        if (due) LOG (info) << "poll: " << s->name << ": periodic poll..";
+        start_source (s);
       }
     }
 
@@ -114,6 +345,10 @@ namespace Astroid {
     if (poll_interval <= 0) {
       LOG (warn) << "poll: poll_interval = 0, setting to default: " << DEFAULT_POLL_INTERVAL;
       poll_interval = DEFAULT_POLL_INTERVAL;
+
+      for (auto s : sources) {
+        if (s->interval <= 0) s->interval = poll_interval;
+      }
     }
 
     auto_polling_enabled = !auto_polling_enabled;
@@ -124,174 +359,139 @@ namespace Astroid {
   }
 
   void Poll::cancel_poll () {
-    LOG (warn) << "poll: cancel polling pid: " << pid;
-    std::lock_guard<std::mutex> lk (poll_cancel_m);
-
-    if (pid > 0) {
-
-      int r = kill (pid, SIGKILL);
-
-      if (r == 0) {
-        LOG (warn) << "poll: poll script killed.";
-      } else {
-        LOG (error) << "poll: could not kill poll script.";
-      }
+    for (auto s : sources) {
+      s->requested = false;
+      s->cancel ();
     }
   }
 
   bool Poll::poll () {
     LOG (debug) << "poll: requested..";
 
-    // set this here as well to avoid lots of checks
-    last_poll = chrono::steady_clock::now ();
-
-    if (m_dopoll.try_lock ()) {
+    bool started = false;
 
-      {
-        Db db (Db::DbMode::DATABASE_READ_ONLY);
-        before_poll_revision = db.get_revision ();
-      }
-      LOG (debug) << "poll: revision before poll: " << before_poll_revision;
+    for (auto s : sources) {
+      if (s->running ()) continue;
 
-      do_poll ();
+      /* the sources over the limit are started when others are done */
+      s->requested = true;
 
-      return true;
+      if (running < max_running) started |= start_source (s);
+    }
 
-    } else {
+    if (!started && running > 0) {
       LOG (warn) << "poll: already in progress.";
-
-      return false;
     }
 
+    return started;
   }
 
-  void Poll::do_poll () {
-    std::unique_lock<std::mutex> lk (poll_cancel_m);
-
-    set_poll_state (true);
+  bool Poll::start_source (PollSource * s) {
+    s->requested = false;
 
-    t0 = chrono::steady_clock::now ();
-
-    path poll_script_uri = astroid->standard_paths().config_dir / path(poll_script);
-    LOG (info) << "poll: polling: " << poll_script_uri.c_str ();
+    if (!polling) {
+      /* m_dopoll is held by the gui thread during external polling */
+      if (external_polling || !m_dopoll.try_lock ()) {
+        LOG (warn) << "poll: " << s->name << ": refresh or external poll in progress, not polling.";
+        return false;
+      }
 
-    if (!is_regular_file (poll_script_uri)) {
-      LOG (error) << "poll: poll script does not exist or is not a regular file.";
+      polling = true;
 
-      m_dopoll.unlock ();
-      set_poll_state (false);
-      return;
+      {
+        Db db (Db::DbMode::DATABASE_READ_ONLY);
+        before_poll_revision = db.get_revision ();
+      }
+      LOG (debug) << "poll: revision before poll: " << before_poll_revision;
     }
 
-    vector<string> args = {poll_script_uri.c_str()};
-    try {
-      Glib::spawn_async_with_pipes ("",
-                        args,
-                        Glib::SPAWN_DO_NOT_REAP_CHILD,
-                        sigc::slot <void> (),
-                        &pid,
-                        NULL,
-                        &stdout,
-                        &stderr
-                        );
-    } catch (Glib::SpawnError &ex) {
-      LOG (error) << "poll: exception while running poll script: " <<  ex.what ();
-      set_poll_state (false);
-      m_dopoll.unlock ();
-      return;
-    } catch (Glib::Error &ex) {
-      LOG (error) << "poll: exception while running poll script: " <<  ex.what ();
-      set_poll_state (false);
-      m_dopoll.unlock ();
-      return;
-    }
+    if (!s->start ()) {
+      back_off (s);
 
-    lk.unlock ();
+      if (running == 0 && !batch_refresh_c.connected ()) {
+        polling = false;
+        m_dopoll.unlock ();
+      }
 
-    /* connect channels */
-    ch_stdout = Glib::IOChannel::create_from_fd (stdout);
-    ch_stderr = Glib::IOChannel::create_from_fd (stderr);
+      return false;
+    }
 
-    c_ch_stdout = Glib::signal_io().connect (sigc::mem_fun (this, &Poll::log_out), stdout, Glib::IO_IN | Glib::IO_HUP);
-    c_ch_stderr = Glib::signal_io().connect (sigc::mem_fun (this, &Poll::log_err), stderr, Glib::IO_IN | Glib::IO_HUP);
+    running++;
+    set_poll_state (true);
+    emit_poll_progress (get_status ());
 
-    Glib::signal_child_watch ().connect (sigc::mem_fun (this, &Poll::poll_child_done), pid);
+    return true;
   }
 
-  void Poll::poll_child_done (GPid pid, int child_status) {
-    g_spawn_close_pid (pid);
-
-    c_ch_stderr.disconnect();
-    c_ch_stdout.disconnect();
+  void Poll::on_source_done (PollSource * s, bool ok) {
+    running--;
 
-    if (ch_stdout) {
-      ch_stdout->close ();
-      ch_stdout.clear ();
-    }
+    if (ok) {
+      s->failures = 0;
+      s->next_poll = chrono::steady_clock::now () + chrono::seconds (s->interval);
 
-    if (ch_stderr) {
-      ch_stderr->close ();
-      ch_stderr.clear ();
+    } else {
+      back_off (s);
     }
 
-    ::close (stdout);
-    ::close (stderr);
-
-    chrono::duration<double> elapsed = chrono::steady_clock::now() - t0;
-    last_poll = chrono::steady_clock::now ();
+    emit_poll_progress (get_status ());
 
-    if (child_status != 0) {
-      LOG (error) << "poll: poll script did not exit successfully.";
+    if (!batch_refresh_c.connected ()) {
+      batch_refresh_c = Glib::signal_timeout ().connect (
+          sigc::mem_fun (this, &Poll::on_batch_refresh), refresh_delay);
     }
+  }
 
-    LOG (info) << "poll: done (time: " << elapsed.count() << " s) (status: " << child_status << ")";
+  void Poll::back_off (PollSource * s) {
+    s->failures++;
 
-    pid = 0;
-    set_poll_state (false);
+    /* twice the interval for every failure */
+    long delay = max (s->interval, 1);
+    for (unsigned int i = 0; i < s->failures && delay < backoff_max; i++) delay *= 2;
+    delay = min (delay, (long) backoff_max);
 
-    d_refresh (); /* signal refresh */
-    m_dopoll.unlock ();
-  }
+    s->next_poll = chrono::steady_clock::now () + chrono::seconds (delay);
 
-  bool Poll::log_out (Glib::IOCondition cond) {
-    if (cond == Glib::IO_HUP) {
-      ch_stdout.clear();
-      LOG (debug) << "poll: (stdout) got HUP";
-      return false;
+    if (s->interval > 0) {
+      LOG (warn) << "poll: " << s->name << ": failed " << s->failures << " times, polling again in " << delay << " s.";
     }
+  }
 
-    if ((cond & Glib::IO_IN) == 0) {
-      LOG (error) << "poll: invalid fifo response";
-    } else {
-      Glib::ustring buf;
-
-      ch_stdout->read_line(buf);
-      if (*(--buf.end()) == '\n') buf.erase (--buf.end());
-
-      LOG (debug) << "poll script: " << buf;
+  void Poll::on_source_output (PollSource *) {
+    emit_poll_progress (get_status ());
+  }
 
+  bool Poll::on_batch_refresh () {
+    if (full_refresh) {
+      refresh_full ();
+    } else {
+      refresh_threads ();
     }
-    return true;
-  }
 
-  bool Poll::log_err (Glib::IOCondition cond) {
-    if (cond == Glib::IO_HUP) {
-      ch_stderr.clear();
-      LOG (debug) << "poll: (stderr) got HUP";
-      return false;
+    if (running == 0) {
+      set_poll_state (false);
+      polling = false;
+      m_dopoll.unlock ();
     }
 
-    if ((cond & Glib::IO_IN) == 0) {
-      LOG (error) << "poll: invalid fifo response";
-    } else {
-      Glib::ustring buf;
+    return false;
+  }
+
+  ustring Poll::get_status () {
+    auto now = chrono::steady_clock::now ();
+    ustring status;
 
-      ch_stderr->read_line(buf);
-      if (*(--buf.end()) == '\n') buf.erase (--buf.end());
+    for (auto s : sources) {
+      if (!status.empty ()) status += "\n";
+      status += s->status ();
 
-      LOG (warn) << "poll script: " << buf;
+      if (!s->running () && auto_polling_enabled && s->interval > 0) {
+        long next = chrono::duration_cast<chrono::seconds> (s->next_poll - now).count ();
+        status += ustring::compose (", next poll in %1 s", std::max<long> (next, 0));
+      }
     }
-    return true;
+
+    return status;
   }
 
   void Poll::refresh (unsigned long before) {
@@ -300,7 +500,7 @@ namespace Astroid {
       return;
     }
 
-    if (m_dopoll.try_lock ()) {
+    if (!polling && m_dopoll.try_lock ()) {
       LOG (info) << "poll: refreshing threads since: " << before;
 
       before_poll_revision = before;
@@ -331,6 +531,9 @@ namespace Astroid {
     unsigned long revnow = db.get_revision ();
     LOG (debug) << "poll: refreshing.. revision after poll: " << revnow;
 
+    /* the watcher continues from here */
+    if (revnow > watch_revision) watch_revision = revnow;
+
     if (revnow > before_poll_revision) {
 
       ustring query = ustring::compose ("lastmod:%1..%2",
@@ -345,11 +548,17 @@ namespace Astroid {
 
       LOG (info) << "poll: " << total_threads << " threads changed, updating..";
 
+      /* the changed threads are signalled at once, so that listeners can
+       * handle them in one pass */
+      vector<ustring> thread_ids;
+
       if (st == NOTMUCH_STATUS_SUCCESS && total_threads > 0) {
         notmuch_threads_t * threads;
         notmuch_thread_t  * thread;
         st = notmuch_query_search_threads (qry, &threads);
 
+        thread_ids.reserve (total_threads);
+
         for (;
              (st == NOTMUCH_STATUS_SUCCESS) && notmuch_threads_valid (threads);
              notmuch_threads_move_to_next (threads)) {
@@ -358,20 +567,37 @@ namespace Astroid {
 
           const char * t = notmuch_thread_get_thread_id (thread);
 
-          ustring tt (t);
-          astroid->actions->emit_thread_updated (&db, tt);
+          thread_ids.push_back (ustring (t));
+          notmuch_thread_destroy (thread);
         }
       }
 
       notmuch_query_destroy (qry);
 
+      if (!thread_ids.empty ()) {
+        astroid->actions->emit_threads_updated (&db, thread_ids);
+      }
+
     }
+
+    /* a poll that is still running continues from here */
+    before_poll_revision = revnow;
   }
 
   void Poll::poll_state_dispatch () {
     emit_poll_state (poll_state);
   }
 
+  Poll::type_signal_poll_progress
+    Poll::signal_poll_progress ()
+  {
+    return m_signal_poll_progress;
+  }
+
+  void Poll::emit_poll_progress (ustring progress) {
+    m_signal_poll_progress.emit (progress);
+  }
+
   Poll::type_signal_poll_state
     Poll::signal_poll_state ()
   {
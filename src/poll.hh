@@ -6,7 +6,9 @@
 # include <mutex>
 # include <condition_variable>
 # include <chrono>
-# include <glibmm/iochannel.h>
+# include <vector>
+# include <giomm/file.h>
+# include <giomm/filemonitor.h>
 
 namespace Astroid {
   class Poll : public sigc::trackable {
@@ -26,7 +28,12 @@ namespace Astroid {
       void refresh (unsigned long before);
       void cancel_poll ();
 
+      /* the state of each poll source, one per line */
+      ustring get_status ();
+
     private:
+      /* held while sources are polling, or while refreshing or external
+       * polling */
       std::mutex m_dopoll;
 
       int poll_interval = 0;
@@ -36,31 +43,59 @@ namespace Astroid {
 
       bool periodic_polling ();
 
-      std::chrono::time_point<std::chrono::steady_clock> t0; // start time of poll
-      std::chrono::time_point<std::chrono::steady_clock> last_poll;
+      /* the sources are polled when they are due or requested, at most
+       * max_running at the time. a source that fails is polled again
+       * after twice the interval for every failure, but at least every
+       * backoff_max seconds. */
+      std::vector<PollSource *> sources;
+      int max_running;
+      int backoff_max; // seconds
+      int running = 0;
+
+      /* m_dopoll is held by the sources */
+      bool polling = false;
+
+      bool start_source (PollSource *);
+      void on_source_done (PollSource *, bool ok);
+      void back_off (PollSource *); // when it fails or cannot be started
+      void on_source_output (PollSource *);
+
+      /* the threads are refreshed once for the sources that are done
+       * within refresh_delay, from the revision before the first of them
+       * started. */
+      const int refresh_delay = 500; // ms
+      sigc::connection batch_refresh_c;
+      bool on_batch_refresh ();
 
       unsigned long before_poll_revision = 0;
       void refresh_threads ();
       void refresh_full ();
 
-      std::mutex  poll_cancel_m;
-      std::condition_variable poll_cancel_cv;
+      /* the database directory is watched so that changes made by others
+       * are refreshed without a poll. events are collected for
+       * watch_delay before the threads changed since watch_revision (the
+       * last refreshed revision) are refreshed. the revisions written by
+       * astroid itself are skipped (Db::skip_written), they have already
+       * been signalled. */
+      int  watch_delay; // ms
+      unsigned long watch_revision = 0;
+
+      refptr<Gio::FileMonitor> db_monitor;
+      std::vector<refptr<Gio::FileMonitor>> maildir_monitors;
 
-      void do_poll ();
-      void poll_child_done (GPid pid, int child_status);
+      void setup_watch (bool watch_maildir);
 
-      GPid pid;
-      int stdout;
-      int stderr;
-      refptr<Glib::IOChannel> ch_stdout;
-      refptr<Glib::IOChannel> ch_stderr;
-      sigc::connection c_ch_stdout;
-      sigc::connection c_ch_stderr;
+      /* the built-in maildir indexer, if enabled */
+      Indexer * indexer = NULL;
+      void on_indexed (unsigned long before);
 
-      Glib::Dispatcher d_refresh;
+      void on_db_changed (const refptr<Gio::File> &, const refptr<Gio::File> &, Gio::FileMonitorEvent);
+      void on_maildir_changed (const refptr<Gio::File> &, const refptr<Gio::File> &, Gio::FileMonitorEvent);
 
-      bool log_out (Glib::IOCondition);
-      bool log_err (Glib::IOCondition);
+      sigc::connection watch_refresh_c;
+      sigc::connection watch_poll_c;
+      bool on_watch_refresh ();
+      bool on_watch_poll ();
 
       bool poll_state;
       void set_poll_state (bool);
@@ -75,8 +110,17 @@ namespace Astroid {
       type_signal_poll_state signal_poll_state ();
 
       void emit_poll_state (bool);
+
+      /* progress of the poll sources: the state of each source (see
+       * get_status ()), when a source starts or is done and at most once a
+       * second while it writes output */
+      typedef sigc::signal <void, ustring> type_signal_poll_progress;
+      type_signal_poll_progress signal_poll_progress ();
+
+      void emit_poll_progress (ustring);
     protected:
       type_signal_poll_state m_signal_poll_state;
+      type_signal_poll_progress m_signal_poll_progress;
   };
 }
 
@@ -0,0 +1,350 @@
+# include <mutex>
+# include <chrono>
+# include <algorithm>
+# include <cerrno>
+# include <sys/wait.h>
+# include <poll.h>
+# include <unistd.h>
+
+# include <boost/filesystem.hpp>
+# include <glibmm/spawn.h>
+
+# include "astroid.hh"
+# include "poll_source.hh"
+# include "config.hh"
+
+using namespace std;
+using namespace boost::filesystem;
+
+namespace Astroid {
+  PollSource::PollSource (ustring _name, vector<string> _argv, int _interval, int _timeout)
+    : name (_name), argv (_argv), interval (_interval), timeout (_timeout)
+  {
+    output_max = astroid->config ().get<unsigned int> ("poll.output_lines");
+
+    /* the first poll is started by Poll, if auto polling is enabled */
+    next_poll = chrono::steady_clock::now () + chrono::seconds (max (interval, 0));
+
+    LOG (debug) << "poll: " << name << ": " << argv[0] << " (interval: " << interval << " s, timeout: " << timeout << " s)";
+  }
+
+  void PollSource::close () {
+    /* the script is not waited for */
+    child_c.disconnect ();
+
+    if (running ()) {
+      cancel ();
+      g_spawn_close_pid (pid);
+
+      std::lock_guard<std::mutex> lk (poll_cancel_m);
+      pid = 0;
+    }
+
+    stop_output ();
+  }
+
+  bool PollSource::running () {
+    return pid > 0;
+  }
+
+  bool PollSource::start () {
+    std::unique_lock<std::mutex> lk (poll_cancel_m);
+
+    t0 = chrono::steady_clock::now ();
+    timed_out = false;
+
+    LOG (info) << "poll: " << name << ": polling: " << argv[0];
+
+    path cmd (argv[0]);
+    if (cmd.is_absolute () && !is_regular_file (cmd)) {
+      LOG (error) << "poll: " << name << ": poll script does not exist or is not a regular file.";
+      return false;
+    }
+
+    try {
+      Glib::spawn_async_with_pipes ("",
+                        argv,
+                        Glib::SPAWN_DO_NOT_REAP_CHILD | Glib::SPAWN_SEARCH_PATH,
+                        sigc::slot <void> (),
+                        &pid,
+                        NULL,
+                        &stdout,
+                        &stderr
+                        );
+    } catch (Glib::SpawnError &ex) {
+      LOG (error) << "poll: " << name << ": exception while running poll script: " <<  ex.what ();
+      pid = 0;
+      return false;
+    } catch (Glib::Error &ex) {
+      LOG (error) << "poll: " << name << ": exception while running poll script: " <<  ex.what ();
+      pid = 0;
+      return false;
+    }
+
+    lk.unlock ();
+
+    /* read the output on a worker */
+    {
+      std::lock_guard<std::mutex> olk (output_m);
+      output.clear ();
+      output_lines  = 0;
+      output_errors = 0;
+      output_shown  = 0;
+      last_line     = "";
+    }
+
+    output_run = true;
+    output_t = std::thread (&PollSource::output_worker, this);
+
+    output_c = Glib::signal_timeout ().connect (
+        sigc::mem_fun (this, &PollSource::on_output), 1000);
+
+    child_c = Glib::signal_child_watch ().connect (sigc::mem_fun (this, &PollSource::child_done), pid);
+
+    return true;
+  }
+
+  void PollSource::cancel () {
+    std::lock_guard<std::mutex> lk (poll_cancel_m);
+
+    if (pid > 0) {
+      LOG (warn) << "poll: " << name << ": cancel polling pid: " << pid;
+
+      int r = kill (pid, SIGKILL);
+
+      if (r == 0) {
+        LOG (warn) << "poll: " << name << ": poll script killed.";
+      } else {
+        LOG (error) << "poll: " << name << ": could not kill poll script.";
+      }
+    }
+  }
+
+  void PollSource::check_timeout () {
+    if (pid <= 0 || timeout <= 0 || timed_out) return;
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - t0;
+
+    if (elapsed.count () >= timeout) {
+      LOG (error) << "poll: " << name << ": poll script timed out after " << timeout << " s.";
+      timed_out = true;
+      cancel ();
+    }
+  }
+
+  void PollSource::child_done (GPid _pid, int child_status) {
+    g_spawn_close_pid (_pid);
+
+    /* the worker reads what is left in the pipes */
+    stop_output ();
+    on_output ();
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - t0;
+
+    bool ok = (child_status == 0 && !timed_out);
+
+    if (!ok) {
+      LOG (error) << "poll: " << name << ": poll script did not exit successfully.";
+      log_output_tail ();
+    }
+
+    LOG (info) << "poll: " << name << ": done (time: " << elapsed.count() << " s) (status: " << child_status << ", output: " << output_lines << " lines)";
+
+    std::unique_lock<std::mutex> lk (poll_cancel_m);
+    pid = 0;
+    lk.unlock ();
+
+    m_signal_done.emit (this, ok);
+  }
+
+  ustring PollSource::status () {
+    if (running ()) {
+      chrono::duration<double> elapsed = chrono::steady_clock::now() - t0;
+
+      /* written by the output worker */
+      unsigned long lines, errors;
+
+      {
+        std::lock_guard<std::mutex> lk (output_m);
+        lines  = output_lines;
+        errors = output_errors;
+      }
+
+      ustring s = ustring::compose ("%1: polling for %2 s, %3 lines of output",
+          name, (int) elapsed.count (), lines);
+
+      if (errors > 0) s += ustring::compose (" (%1 on stderr)", errors);
+      if (!last_line.empty ()) s += ": " + last_line;
+
+      return s;
+    }
+
+    if (failures > 0) {
+      return ustring::compose ("%1: failed %2 times", name, failures);
+    }
+
+    return ustring::compose ("%1: idle", name);
+  }
+
+  /* output */
+  void PollSource::output_worker () {
+    struct pollfd fds[2] = {
+      { stdout, POLLIN, 0 },
+      { stderr, POLLIN, 0 },
+    };
+
+    std::string partial[2];
+    char buf[8192];
+
+    /* when the script is done what is left in the pipes is read without
+     * waiting, at most OUTPUT_DRAIN times: processes the script left
+     * behind may hold the pipes open and keep writing. */
+    unsigned int drained = 0;
+
+    while (fds[0].fd >= 0 || fds[1].fd >= 0) {
+      bool done = !output_run;
+      if (done && drained++ >= OUTPUT_DRAIN) break;
+
+      int r = ::poll (fds, 2, done ? 0 : 100);
+
+      if (r < 0) {
+        if (errno == EINTR) continue;
+        LOG (error) << "poll: " << name << ": could not read output of poll script.";
+        break;
+      }
+
+      if (r == 0) {
+        if (done) break;
+        continue;
+      }
+
+      for (int i = 0; i < 2; i++) {
+        if (fds[i].fd < 0 || fds[i].revents == 0) continue;
+
+        ssize_t n = ::read (fds[i].fd, buf, sizeof (buf));
+
+        if (n < 0 && errno == EINTR) continue;
+
+        vector<string> lines;
+
+        if (n <= 0) {
+          /* closed */
+          fds[i].fd = -1;
+          if (!partial[i].empty ()) lines.push_back (partial[i]);
+          partial[i].clear ();
+
+        } else {
+          partial[i].append (buf, n);
+
+          size_t start = 0, end;
+          while ((end = partial[i].find ('\n', start)) != string::npos) {
+            lines.push_back (partial[i].substr (start, end - start));
+            start = end + 1;
+          }
+
+          partial[i].erase (0, start);
+        }
+
+        if (!lines.empty ()) add_output (i == 1, lines);
+      }
+    }
+
+    for (int i = 0; i < 2; i++) {
+      if (!partial[i].empty ()) {
+        vector<string> lines = { partial[i] };
+        add_output (i == 1, lines);
+      }
+    }
+  }
+
+  void PollSource::stop_output () {
+    output_run = false;
+    if (output_t.joinable ()) output_t.join ();
+
+    output_c.disconnect ();
+
+    if (stdout >= 0) ::close (stdout);
+    if (stderr >= 0) ::close (stderr);
+
+    stdout = -1;
+    stderr = -1;
+  }
+
+  void PollSource::add_output (bool err, vector<string> & lines) {
+    std::lock_guard<std::mutex> lk (output_m);
+
+    for (auto & l : lines) {
+      output_lines++;
+      if (err) output_errors++;
+
+      output.push_back (OutputLine { output_lines, err, std::move (l) });
+      if (output.size () > output_max) output.pop_front ();
+    }
+  }
+
+  bool PollSource::on_output () {
+    /* runs on gui thread */
+    vector<OutputLine> errors;
+    ustring last;
+    unsigned long n, total;
+
+    std::unique_lock<std::mutex> lk (output_m);
+
+    n = output_lines - output_shown;
+
+    for (auto & l : output) {
+      if (l.seq > output_shown && l.err) errors.push_back (l);
+    }
+
+    if (!output.empty ()) last = output.back ().line;
+
+    output_shown = output_lines;
+    total        = output_lines;
+
+    lk.unlock ();
+
+    if (n == 0) return true;
+
+    unsigned int shown = 0;
+    for (auto & l : errors) {
+      if (shown++ >= OUTPUT_ERRORS_SHOWN) break;
+      LOG (warn) << "poll script: " << name << ": " << l.line;
+    }
+
+    if (errors.size () > OUTPUT_ERRORS_SHOWN) {
+      LOG (warn) << "poll script: " << name << ": (" << (errors.size () - OUTPUT_ERRORS_SHOWN) << " more lines on stderr)";
+    }
+
+    if (!last.validate ()) last = "";
+    last_line = last;
+
+    LOG (debug) << "poll script: " << name << ": " << n << " new lines (" << total << " in total), last: " << last;
+
+    m_signal_output.emit (this);
+
+    return true;
+  }
+
+  void PollSource::log_output_tail () {
+    std::lock_guard<std::mutex> lk (output_m);
+
+    if (output.empty ()) return;
+
+    auto start = output.size () > OUTPUT_TAIL ? output.end () - OUTPUT_TAIL : output.begin ();
+
+    LOG (error) << "poll: " << name << ": last lines of output:";
+    for (auto it = start; it != output.end (); it++) {
+      LOG (error) << "poll script: " << name << ": " << (it->err ? "(stderr) " : "") << it->line;
+    }
+  }
+
+  /* signals */
+  PollSource::type_signal_done PollSource::signal_done () {
+    return m_signal_done;
+  }
+
+  PollSource::type_signal_output PollSource::signal_output () {
+    return m_signal_output;
+  }
+}
+
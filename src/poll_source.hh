@@ -0,0 +1,105 @@
+# pragma once
+
+# include <thread>
+# include <mutex>
+# include <atomic>
+# include <chrono>
+# include <deque>
+# include <vector>
+# include <string>
+
+# include <glibmm.h>
+# include <sigc++/sigc++.h>
+
+# include "proto.hh"
+
+namespace Astroid {
+  /* a script or command that fetches mail, e.g. for one account. it is
+   * run by Poll, which schedules the sources and refreshes the threads
+   * when they are done. */
+  class PollSource : public sigc::trackable {
+    public:
+      PollSource (ustring name, std::vector<std::string> argv, int interval, int timeout);
+      void close ();
+
+      ustring                   name;
+      std::vector<std::string>  argv;
+      int                       interval; // seconds, <= 0: only when polling manually
+      int                       timeout;  // seconds, <= 0: none
+
+      /* scheduling, managed by Poll */
+      std::chrono::steady_clock::time_point next_poll;
+      unsigned int  failures  = 0;
+      bool          requested = false;
+
+      bool start ();
+      void cancel ();
+      bool running ();
+
+      /* kill the command when it has been running longer than timeout */
+      void check_timeout ();
+
+      /* one line describing the state of the source */
+      ustring status ();
+
+      /* emitted when the command is done, and whether it succeeded */
+      typedef sigc::signal <void, PollSource *, bool> type_signal_done;
+      type_signal_done signal_done ();
+
+      /* emitted at most once a second while the command writes output */
+      typedef sigc::signal <void, PollSource *> type_signal_output;
+      type_signal_output signal_output ();
+
+    private:
+      std::mutex poll_cancel_m;
+
+      GPid pid = 0;
+      int stdout = -1;
+      int stderr = -1;
+      bool timed_out = false;
+
+      std::chrono::steady_clock::time_point t0; // start time of poll
+
+      sigc::connection child_c;
+      void child_done (GPid pid, int child_status);
+
+      /* the output of the command is read in chunks on a worker thread
+       * and the last output_max lines are kept. the lines are not logged
+       * one by one: a summary of the new output and the lines on stderr
+       * are logged at most once a second. */
+      struct OutputLine {
+        unsigned long seq;
+        bool          err;
+        std::string   line;
+      };
+
+      std::thread output_t;
+      std::atomic<bool> output_run { false };
+      void output_worker ();
+      void add_output (bool err, std::vector<std::string> & lines);
+
+      /* stop the worker and close the pipes */
+      void stop_output ();
+
+      std::mutex output_m;
+      std::deque<OutputLine> output;
+      unsigned int  output_max;
+      unsigned long output_lines  = 0; // total lines of this poll
+      unsigned long output_errors = 0; // lines on stderr
+      unsigned long output_shown  = 0; // lines summarized
+      ustring last_line;
+
+      sigc::connection output_c;
+      bool on_output ();
+      void log_output_tail ();
+
+      static const unsigned int OUTPUT_ERRORS_SHOWN = 10; // per summary
+      static const unsigned int OUTPUT_TAIL = 20;         // on failure
+      static const unsigned int OUTPUT_DRAIN = 16;        // reads when done
+
+    protected:
+      type_signal_done m_signal_done;
+      type_signal_output m_signal_output;
+  };
+}
+
@@ -23,7 +23,11 @@ namespace Astroid {
   class Account;
   //class Contacts;
   class Poll;
+  class PollSource;
+  class Indexer;
   class PluginManager;
+  class AvatarCache;
+  class MessagePrefetch;
 
   /* message and thread */
   class Message;
@@ -40,6 +44,7 @@ namespace Astroid {
   class ToggleAction;
   class SpamAction;
   class MuteAction;
+  class TagJournal;
 
   /* user interface */
   class MainWindow;
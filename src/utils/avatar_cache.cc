@@ -0,0 +1,289 @@
+# include <iostream>
+# include <fstream>
+# include <sstream>
+# include <ctime>
+
+# include <gtkmm.h>
+# include <boost/filesystem.hpp>
+
+# include "avatar_cache.hh"
+# include "astroid.hh"
+# include "config.hh"
+# include "crypto.hh"
+# include "utils/utils.hh"
+
+using namespace std;
+
+namespace Astroid {
+  AvatarCache::AvatarCache () {
+    LOG (info) << "avatars: set up.";
+
+    const ptree& config = astroid->config ("thread_view.avatar");
+
+    use_disk_cache = config.get<bool> ("cache");
+
+    ustring ld = config.get<string> ("directory");
+    if (!ld.empty ()) {
+      local_dir = Utils::expand (bfs::path (ld.c_str ()));
+
+      if (!bfs::is_directory (local_dir)) {
+        LOG (warn) << "avatars: local avatar directory does not exist: " << local_dir.c_str ();
+      }
+    }
+
+    cache_dir = astroid->standard_paths ().cache_dir / bfs::path ("avatars");
+
+    if (use_disk_cache && !bfs::is_directory (cache_dir)) {
+      LOG (debug) << "avatars: making cache dir..";
+      boost::system::error_code ec;
+      bfs::create_directories (cache_dir, ec);
+
+      if (ec) {
+        LOG (error) << "avatars: could not create cache dir, disabling disk cache: " << ec.message ();
+        use_disk_cache = false;
+      }
+    }
+
+    results_ready.connect (
+        sigc::mem_fun (this, &AvatarCache::on_results_ready));
+
+    run = true;
+    avatar_worker_t = std::thread (&AvatarCache::avatar_worker, this);
+  }
+
+  void AvatarCache::close () {
+    if (!run) return;
+
+    LOG (debug) << "avatars: closing..";
+
+    std::unique_lock<std::mutex> lk (requests_m);
+    run = false;
+    requests.clear ();
+    lk.unlock ();
+
+    requests_cv.notify_one ();
+    avatar_worker_t.join ();
+  }
+
+  bool AvatarCache::has_local_directory () {
+    return !local_dir.empty ();
+  }
+
+  AvatarCache::Status AvatarCache::lookup (ustring email, ustring & data_uri) {
+    email = email.lowercase ();
+
+    auto a = avatars.find (email);
+    if (a != avatars.end ()) {
+      data_uri = a->second;
+      return (data_uri.empty () ? Missing : Found);
+    }
+
+    if (pending.count (email)) return Pending;
+
+    return Unknown;
+  }
+
+  void AvatarCache::request (ustring email, ustring source) {
+    email = email.lowercase ();
+
+    if (avatars.count (email) || pending.count (email)) return;
+
+    pending.insert (email);
+
+    std::lock_guard<std::mutex> lk (requests_m);
+    requests.push_back (std::make_pair (email, source));
+    requests_cv.notify_one ();
+  }
+
+  void AvatarCache::avatar_worker () {
+    while (run) {
+      std::unique_lock<std::mutex> lk (requests_m);
+      requests_cv.wait (lk, [&] { return (!requests.empty () || !run); });
+
+      while (run && !requests.empty ()) {
+        ustring email, source;
+        std::tie (email, source) = requests.front ();
+        requests.pop_front ();
+
+        lk.unlock ();
+
+        ustring uri;
+        bool persistent = true;
+
+        /* local avatars always take precedence and are not cached */
+        uri = read_local (email);
+
+        if (uri.empty ()) {
+          if (!(use_disk_cache && read_cache (email, uri))) {
+            if (!source.empty ()) {
+              persistent = fetch (source, uri);
+            }
+
+            if (persistent && use_disk_cache) write_cache (email, uri);
+          }
+        }
+
+        std::unique_lock<std::mutex> rlk (results_m);
+        results.push_back (std::make_tuple (email, uri, persistent));
+        rlk.unlock ();
+
+        results_ready.emit ();
+
+        lk.lock ();
+      }
+    }
+  }
+
+  void AvatarCache::on_results_ready () {
+    /* runs on gui thread */
+    std::unique_lock<std::mutex> lk (results_m);
+    auto rs = std::move (results);
+    results.clear ();
+    lk.unlock ();
+
+    for (auto &r : rs) {
+      ustring email, uri;
+      bool persistent;
+      std::tie (email, uri, persistent) = r;
+
+      pending.erase (email);
+
+      /* a failed fetch is only remembered for this session */
+      avatars[email] = uri;
+
+      LOG (debug) << "avatars: resolved: " << email << (uri.empty () ? " (missing)" : "") << (persistent ? "" : " (not cached)");
+
+      m_signal_avatar_ready.emit (email, uri);
+    }
+  }
+
+  bfs::path AvatarCache::cache_file (ustring email) {
+    return cache_dir / bfs::path (Crypto::get_md5_digest (email).c_str ());
+  }
+
+  bool AvatarCache::read_cache (ustring email, ustring & data_uri) {
+    bfs::path f = cache_file (email);
+    bfs::path m = f;
+    m += ".missing";
+
+    boost::system::error_code ec;
+
+    if (bfs::is_regular_file (f, ec)) {
+      std::ifstream s (f.c_str ());
+      std::stringstream b;
+      b << s.rdbuf ();
+      data_uri = b.str ();
+
+      return !data_uri.empty ();
+
+    } else if (bfs::is_regular_file (m, ec)) {
+      std::time_t t = bfs::last_write_time (m, ec);
+
+      if (!ec && (std::time (NULL) - t) < NEGATIVE_TTL) {
+        data_uri = "";
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void AvatarCache::write_cache (ustring email, ustring data_uri) {
+    bfs::path f = cache_file (email);
+    bfs::path m = f;
+    m += ".missing";
+
+    boost::system::error_code ec;
+
+    if (data_uri.empty ()) {
+      bfs::remove (f, ec);
+      std::ofstream s (m.c_str ());
+
+    } else {
+      bfs::remove (m, ec);
+      std::ofstream s (f.c_str ());
+      s << data_uri;
+    }
+  }
+
+  ustring AvatarCache::read_local (ustring email) {
+    /* avatars in the local directory are named by address, e.g.:
+     * foo@example.com.png */
+    if (local_dir.empty ()) return "";
+
+    for (const char * ext : { ".png", ".jpg", ".jpeg", ".gif", ".svg" }) {
+      bfs::path f = local_dir / bfs::path ((email + ext).c_str ());
+
+      boost::system::error_code ec;
+      if (bfs::is_regular_file (f, ec)) {
+        std::ifstream s (f.c_str (), std::ios::binary);
+        std::stringstream b;
+        b << s.rdbuf ();
+        std::string d = b.str ();
+
+        ustring uri = make_data_uri (d.data (), d.size ());
+        if (!uri.empty ()) return uri;
+      }
+    }
+
+    return "";
+  }
+
+  bool AvatarCache::fetch (ustring source, ustring & data_uri) {
+    /* returns false if the source could not be reached, in which case the
+     * source itself is returned so that the thread view may try to load it
+     * directly */
+
+    if (source.find ("data:") == 0) {
+      data_uri = source;
+      return true;
+    }
+
+    try {
+      auto f = Gio::File::create_for_uri (source);
+
+      char * contents;
+      gsize  length;
+      f->load_contents (contents, length);
+
+      data_uri = make_data_uri (contents, length);
+      g_free (contents);
+
+      return true;
+
+    } catch (Glib::Error &ex) {
+      LOG (debug) << "avatars: could not fetch: " << source << ": " << ex.what ();
+
+      data_uri = source;
+      return false;
+    }
+  }
+
+  ustring AvatarCache::make_data_uri (const char * data, gsize len) {
+    /* scale image to avatar size and encode as png */
+    try {
+      auto mis = Gio::MemoryInputStream::create ();
+      mis->add_data (data, len);
+
+      auto pb = Gdk::Pixbuf::create_from_stream_at_scale (mis, SIZE, SIZE, true, refptr<Gio::Cancellable>());
+
+      gchar * content;
+      gsize   content_size;
+      pb->save_to_buffer (content, content_size, "png");
+
+      ustring uri = "data:image/png;base64," + Glib::Base64::encode (std::string (content, content_size));
+      g_free (content);
+
+      return uri;
+
+    } catch (Glib::Error &ex) {
+      LOG (warn) << "avatars: could not load image: " << ex.what ();
+      return "";
+    }
+  }
+
+  AvatarCache::type_signal_avatar_ready AvatarCache::signal_avatar_ready () {
+    return m_signal_avatar_ready;
+  }
+}
+
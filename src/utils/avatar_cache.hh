@@ -0,0 +1,93 @@
+# pragma once
+
+# include <map>
+# include <set>
+# include <deque>
+# include <tuple>
+# include <thread>
+# include <mutex>
+# include <atomic>
+# include <condition_variable>
+
+# include <glibmm.h>
+# include <sigc++/sigc++.h>
+# include <boost/filesystem.hpp>
+
+# include "proto.hh"
+
+namespace bfs = boost::filesystem;
+
+namespace Astroid {
+  /* resolves the avatars of sender addresses to data uris on a worker
+   * thread. avatars are looked up in a local avatar directory, in a
+   * persistent cache on disk and finally fetched from their source uri
+   * (gravatar or plugin). addresses without an avatar are cached as
+   * well. */
+  class AvatarCache {
+    public:
+      AvatarCache ();
+      void close ();
+
+      static const int SIZE = 48; // px
+
+      enum Status {
+        Unknown,
+        Pending,
+        Found,
+        Missing,
+      };
+
+      /* look up avatar in memory, data_uri is set if it is found. gui
+       * thread only. */
+      Status lookup (ustring email, ustring & data_uri);
+
+      /* queue the avatar for resolving, source is a remote or local
+       * uri that is fetched if the avatar is neither in the local avatar
+       * directory nor in the disk cache. gui thread only. */
+      void request (ustring email, ustring source);
+
+      bool has_local_directory ();
+
+      /* emitted on the gui thread when an avatar has been resolved, with an
+       * empty uri if there is none. */
+      typedef sigc::signal <void, ustring, ustring> type_signal_avatar_ready;
+      type_signal_avatar_ready signal_avatar_ready ();
+
+    private:
+      std::atomic<bool> run { false };
+      std::thread avatar_worker_t;
+      void avatar_worker ();
+
+      std::mutex requests_m;
+      std::condition_variable requests_cv;
+      std::deque<std::pair<ustring, ustring>> requests; // email, source
+
+      std::mutex results_m;
+      std::deque<std::tuple<ustring, ustring, bool>> results; // email, uri, persistent
+
+      Glib::Dispatcher results_ready;
+      void on_results_ready ();
+
+      /* resolved avatars, empty uri if missing. gui thread only. */
+      std::map<ustring, ustring> avatars;
+      std::set<ustring>          pending;
+
+      bool      use_disk_cache;
+      bfs::path cache_dir;
+      bfs::path local_dir;
+
+      /* addresses without an avatar are retried after this many seconds */
+      static const int NEGATIVE_TTL = 7 * 24 * 3600;
+
+      bfs::path cache_file (ustring email);
+      bool      read_cache (ustring email, ustring & data_uri);
+      void      write_cache (ustring email, ustring data_uri);
+      ustring   read_local (ustring email);
+      bool      fetch (ustring source, ustring & data_uri);
+      ustring   make_data_uri (const char * data, gsize len);
+
+    protected:
+      type_signal_avatar_ready m_signal_avatar_ready;
+  };
+}
+
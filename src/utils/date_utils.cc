@@ -3,6 +3,7 @@
 # include <boost/property_tree/ptree.hpp>
 # include <glibmm/datetime.h>
 # include <time.h>
+# include <limits>
 
 # include "astroid.hh"
 # include "config.hh"
@@ -60,14 +61,66 @@ namespace Astroid {
 
   Date::ClockFormat Date::clock_format;
 
+  std::map<time_t, Date::PrettyDate> Date::pretty_cache;
+  std::mutex Date::pretty_cache_m;
+  time_t     Date::next_midnight = 0;
+
   ustring Date::pretty_print (time_t t) {
+    time_t expires;
+    return pretty_print (t, expires);
+  }
+
+  ustring Date::pretty_print (time_t t, time_t & expires) {
+    time_t now = time (NULL);
+
+    std::lock_guard<std::mutex> lk (pretty_cache_m);
+
+    if (now >= next_midnight) {
+      /* all dates relative to today are stale */
+      pretty_cache.clear ();
+
+      struct tm * temp_t = localtime (&now);
+      struct tm m = *temp_t;
+      m.tm_mday += 1;
+      m.tm_hour  = 0;
+      m.tm_min   = 0;
+      m.tm_sec   = 0;
+      m.tm_isdst = -1;
+
+      next_midnight = mktime (&m);
+    }
+
+    auto p = pretty_cache.find (t);
+    if (p != pretty_cache.end () && now < p->second.expires) {
+      expires = p->second.expires;
+      return p->second.str;
+    }
+
+    if (pretty_cache.size () >= pretty_cache_size) pretty_cache.clear ();
+
+    PrettyDate pd;
+    pd.str     = make_pretty (t, now, pd.expires);
+    pd.expires = min (pd.expires, next_midnight);
+
+    pretty_cache[t] = pd;
+
+    expires = pd.expires;
+    return pd.str;
+  }
+
+  ustring Date::make_pretty (time_t t, time_t now, time_t & expires) {
     struct tm * temp_t = localtime (&t);
     struct tm local_time = *temp_t;
 
-    time_t now  = time (NULL);
+    temp_t = localtime (&now);
+    struct tm now_time = *temp_t;
+
     time_t diff = now - t;
 
-    CoarseDate cd = coarse_date (t);
+    CoarseDate cd = coarse_date (local_time, now_time, diff);
+
+    /* dates that are not relative to now only change at midnight */
+    expires = std::numeric_limits<time_t>::max ();
 
     ustring fmt;
 	if (clock_format == ClockFormat::YEAR) {
@@ -84,12 +137,15 @@ namespace Astroid {
 	else {
 		switch (cd) {
 		case CoarseDate::NOW:
+			expires = t + 60;
 			return "Now";
 
 		case CoarseDate::MINUTES:
+			expires = t + 60 * (diff / 60 + 1);
 			return ustring::compose("%1m ago", (unsigned long) (diff / 60));
 
 		case CoarseDate::HOURS:
+			expires = t + (60 * 60) * (diff / (60 * 60) + 1);
 			return ustring::compose("%1h ago", (unsigned long) (diff / (60 * 60)));
 
 		case CoarseDate::TODAY:
@@ -109,8 +165,12 @@ namespace Astroid {
 			fmt = same_year;
 			break;
 
-		case CoarseDate::YEARS:
 		case CoarseDate::FUTURE:
+			if (diff < 0) expires = t;
+			fmt = diff_year;
+			break;
+
+		case CoarseDate::YEARS:
 		default:
 			fmt = diff_year;
 			break;
@@ -175,6 +235,9 @@ namespace Astroid {
 
     /* diff year */
     diff_year = config.get<string>("diff_year");
+
+    std::lock_guard<std::mutex> lk (pretty_cache_m);
+    pretty_cache.clear ();
   }
 
   Date::CoarseDate Date::coarse_date (time_t t) {
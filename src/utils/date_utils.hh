@@ -1,5 +1,8 @@
 # pragma once
 
+# include <map>
+# include <mutex>
+
 # include "astroid.hh"
 
 namespace Astroid {
@@ -44,10 +47,28 @@ namespace Astroid {
       static CoarseDate coarse_date (struct tm, struct tm, time_t );
       static CoarseDate coarse_date (time_t t);
       static ustring pretty_print (time_t );
+
+      /* pretty printed dates are cached until they change, expires is set
+       * to the time when the returned string goes stale (e.g. "3m ago"). */
+      static ustring pretty_print (time_t, time_t & expires);
       static ustring pretty_print_verbose (time_t, bool = false);
 
       static ustring asctime (time_t t);
 
       static void init ();
+
+    private:
+      struct PrettyDate {
+        ustring str;
+        time_t  expires;
+      };
+
+      /* keyed by timestamp, cleared when the day changes */
+      static std::map<time_t, PrettyDate> pretty_cache;
+      static std::mutex pretty_cache_m;
+      static time_t     next_midnight;
+      static const unsigned int pretty_cache_size = 10000;
+
+      static ustring make_pretty (time_t t, time_t now, time_t & expires);
   };
 }
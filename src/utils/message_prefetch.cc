@@ -0,0 +1,207 @@
+# include <vector>
+# include <string>
+# include <chrono>
+
+# include <glib.h>
+# include <gmime/gmime.h>
+# include "utils/gmime/gmime-compat.h"
+
+# include "message_prefetch.hh"
+# include "astroid.hh"
+# include "config.hh"
+# include "db.hh"
+
+using namespace std;
+
+namespace Astroid {
+  MessagePrefetch::MessagePrefetch () {
+    const ptree& config = astroid->config ("thread_index.prefetch");
+
+    enable   = config.get<bool> ("enable");
+    max_size = config.get<unsigned long> ("cache_size") * 1024 * 1024;
+
+    if (max_size == 0) enable = false;
+
+    LOG (info) << "prefetch: set up (enabled: " << enable << ", cache: " << max_size << " bytes).";
+
+    if (!enable) return;
+
+    run = true;
+    prefetch_worker_t = std::thread (&MessagePrefetch::prefetch_worker, this);
+  }
+
+  void MessagePrefetch::close () {
+    if (!run) return;
+
+    LOG (debug) << "prefetch: closing..";
+
+    std::unique_lock<std::mutex> lk (requests_m);
+    run = false;
+    requests.clear ();
+    generation++;
+    lk.unlock ();
+
+    requests_cv.notify_one ();
+    prefetch_worker_t.join ();
+
+    clear ();
+  }
+
+  bool MessagePrefetch::enabled () {
+    return run;
+  }
+
+  void MessagePrefetch::request (std::vector<ustring> thread_ids) {
+    if (!run) return;
+
+    std::lock_guard<std::mutex> lk (requests_m);
+    generation++;
+    requests.assign (thread_ids.begin (), thread_ids.end ());
+    requests_cv.notify_one ();
+  }
+
+  void MessagePrefetch::cancel () {
+    if (!run) return;
+
+    std::lock_guard<std::mutex> lk (requests_m);
+    generation++;
+    requests.clear ();
+  }
+
+  void MessagePrefetch::prefetch_worker () {
+    while (run) {
+      std::unique_lock<std::mutex> lk (requests_m);
+      requests_cv.wait (lk, [&] { return (!requests.empty () || !run); });
+
+      while (run && !requests.empty ()) {
+        ustring thread_id = requests.front ();
+        requests.pop_front ();
+        unsigned long gen = generation;
+
+        lk.unlock ();
+
+        prefetch_thread (thread_id, gen);
+
+        lk.lock ();
+      }
+    }
+  }
+
+  void MessagePrefetch::prefetch_thread (ustring thread_id, unsigned long gen) {
+    auto t0 = chrono::steady_clock::now ();
+
+    /* only keep the database open while looking up the files, so that
+     * writers are not held up while parsing. */
+    vector<string> fnames;
+
+    {
+      Db db (Db::DbMode::DATABASE_READ_ONLY);
+
+      db.on_thread (thread_id, [&] (notmuch_thread_t * nm_thread) {
+          notmuch_messages_t * ms;
+
+          for (ms = notmuch_thread_get_messages (nm_thread);
+               notmuch_messages_valid (ms);
+               notmuch_messages_move_to_next (ms)) {
+
+            notmuch_message_t * m = notmuch_messages_get (ms);
+            const char * c = notmuch_message_get_filename (m);
+            if (c != NULL) fnames.push_back (c);
+            notmuch_message_destroy (m);
+          }
+        });
+    }
+
+    unsigned int n = 0;
+
+    for (auto & fname : fnames) {
+      if (gen != generation || !run) {
+        LOG (debug) << "prefetch: " << thread_id << ": dropped.";
+        return;
+      }
+
+      if (cached (fname)) continue;
+
+      gchar * contents;
+      gsize   length;
+
+      if (!g_file_get_contents (fname.c_str (), &contents, &length, NULL)) {
+        /* the thread view reports missing files */
+        continue;
+      }
+
+      /* the parts of the message are read lazily from the stream, which
+       * is in memory so that the file does not have to be read again. */
+      GMimeStream  * stream  = g_mime_stream_mem_new_with_byte_array (
+          g_byte_array_new_take ((guint8 *) contents, length));
+      GMimeParser  * parser  = g_mime_parser_new_with_stream (stream);
+      GMimeMessage * message = g_mime_parser_construct_message (parser, g_mime_parser_options_get_default ());
+
+      if (message != NULL) {
+        add (fname, message, length);
+        g_object_unref (message);
+        n++;
+      }
+
+      g_object_unref (stream);
+      g_object_unref (parser);
+    }
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now () - t0;
+    LOG (debug) << "prefetch: " << thread_id << ": parsed " << n << " of " << fnames.size ()
+                << " messages in " << (elapsed.count () * 1000.) << " ms.";
+  }
+
+  /* cache */
+  bool MessagePrefetch::cached (const std::string & fname) {
+    std::lock_guard<std::mutex> lk (cache_m);
+    return cache.count (fname) > 0;
+  }
+
+  void MessagePrefetch::add (const std::string & fname, GMimeMessage * message, unsigned long size) {
+    std::lock_guard<std::mutex> lk (cache_m);
+
+    if (size > max_size || cache.count (fname)) return;
+
+    /* make room, oldest first */
+    while (cache_size + size > max_size && !ages.empty ()) {
+      auto e = cache.find (ages.front ());
+      cache_size -= e->second.size;
+      g_object_unref (e->second.message);
+      cache.erase (e);
+      ages.pop_front ();
+    }
+
+    g_object_ref (message);
+    ages.push_back (fname);
+    cache[fname] = Entry { message, size, std::prev (ages.end ()) };
+    cache_size += size;
+  }
+
+  GMimeMessage * MessagePrefetch::take (std::string fname) {
+    std::lock_guard<std::mutex> lk (cache_m);
+
+    auto e = cache.find (fname);
+    if (e == cache.end ()) return NULL;
+
+    GMimeMessage * message = e->second.message; // reference passed on to caller
+    cache_size -= e->second.size;
+    ages.erase (e->second.age);
+    cache.erase (e);
+
+    LOG (debug) << "prefetch: using prefetched message: " << fname;
+
+    return message;
+  }
+
+  void MessagePrefetch::clear () {
+    std::lock_guard<std::mutex> lk (cache_m);
+
+    for (auto & e : cache) g_object_unref (e.second.message);
+
+    cache.clear ();
+    ages.clear ();
+    cache_size = 0;
+  }
+}
+
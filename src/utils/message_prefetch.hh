@@ -0,0 +1,77 @@
+# pragma once
+
+# include <list>
+# include <deque>
+# include <vector>
+# include <string>
+# include <thread>
+# include <mutex>
+# include <atomic>
+# include <condition_variable>
+# include <unordered_map>
+
+# include <glibmm.h>
+# include <gmime/gmime.h>
+
+# include "proto.hh"
+
+namespace Astroid {
+  /* parses the messages of threads that are likely to be opened next on a
+   * worker thread, so that loading the thread view does not have to wait
+   * for reading and parsing the message files.
+   *
+   * the parsed messages are kept by file name in a cache that is bounded
+   * by the size of the files, the least recently prefetched messages are
+   * dropped first. a message is removed from the cache when it is taken. */
+  class MessagePrefetch {
+    public:
+      MessagePrefetch ();
+      void close ();
+
+      bool enabled ();
+
+      /* replace the queued threads, the thread that is being prefetched
+       * is dropped as well. gui thread only. */
+      void request (std::vector<ustring> thread_ids);
+      void cancel ();
+
+      /* take the parsed message for file name, returns a new reference or
+       * NULL if it has not been prefetched. may be called from any
+       * thread. */
+      GMimeMessage * take (std::string fname);
+
+    private:
+      bool enable;
+      unsigned long max_size; // bytes
+
+      std::atomic<bool> run { false };
+      std::thread prefetch_worker_t;
+      void prefetch_worker ();
+
+      std::mutex requests_m;
+      std::condition_variable requests_cv;
+      std::deque<ustring> requests;
+
+      /* bumped when the requests are replaced, the worker stops
+       * prefetching a thread from an older generation */
+      std::atomic<unsigned long> generation { 0 };
+
+      void prefetch_thread (ustring thread_id, unsigned long gen);
+
+      struct Entry {
+        GMimeMessage * message;
+        unsigned long  size;
+        std::list<std::string>::iterator age;
+      };
+
+      std::mutex cache_m;
+      std::unordered_map<std::string, Entry> cache;
+      std::list<std::string> ages; // oldest first
+      unsigned long cache_size = 0;
+
+      bool cached (const std::string & fname);
+      void add (const std::string & fname, GMimeMessage *, unsigned long size);
+      void clear ();
+  };
+}
+
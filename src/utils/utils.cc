@@ -21,6 +21,8 @@ namespace Astroid {
   Pango::Color Utils::tags_upper_color;
   Pango::Color Utils::tags_lower_color;
   float        Utils::tags_alpha;
+  unsigned long Utils::tag_colors_version = 0;
+  std::map<std::pair<std::string, guint32>, Utils::TagColors> Utils::tag_colors;
 
   void Utils::init () {
     ptree ti = astroid->config ("thread_index.cell");
@@ -44,6 +46,13 @@ namespace Astroid {
     tags_alpha = ti.get<float> ("tags_alpha");
     if (tags_alpha > 1) tags_alpha = 1;
     if (tags_alpha < 0) tags_alpha = 0;
+
+    clear_tag_colors ();
+  }
+
+  void Utils::clear_tag_colors () {
+    tag_colors.clear ();
+    tag_colors_version++;
   }
 
   ustring Utils::format_size (int sz) {
@@ -106,7 +115,28 @@ namespace Astroid {
     return str.str ();
   }
 
-  std::pair<Gdk::RGBA, Gdk::RGBA> Utils::get_tag_color_rgba (ustring t, unsigned char cv[3])
+  Utils::TagColors & Utils::lookup_tag_colors (ustring t, guint8 cv[3]) {
+    auto key = std::make_pair (t.raw (),
+        (guint32) ((cv[0] << 16) | (cv[1] << 8) | cv[2]));
+
+    auto c = tag_colors.find (key);
+
+    if (c == tag_colors.end ()) {
+      TagColors tc;
+      tc.rgba = make_tag_color_rgba (t, cv);
+      tc.hex  = std::make_pair (rgba_to_hex (tc.rgba.first), rgba_to_hex (tc.rgba.second));
+
+      c = tag_colors.insert (std::make_pair (key, tc)).first;
+    }
+
+    return c->second;
+  }
+
+  std::pair<Gdk::RGBA, Gdk::RGBA> Utils::get_tag_color_rgba (ustring t, unsigned char cv[3]) {
+    return lookup_tag_colors (t, cv).rgba;
+  }
+
+  std::pair<Gdk::RGBA, Gdk::RGBA> Utils::make_tag_color_rgba (ustring t, unsigned char cv[3])
   {
     # ifndef DISABLE_PLUGINS
 
@@ -171,9 +201,7 @@ namespace Astroid {
   }
 
   std::pair<ustring, ustring> Utils::get_tag_color (ustring t, guint8 cv[3]) {
-    auto clrs = get_tag_color_rgba (t, cv);
-
-    return std::make_pair (rgba_to_hex (clrs.first), rgba_to_hex (clrs.second));
+    return lookup_tag_colors (t, cv).hex;
   }
 }
 
@@ -2,6 +2,7 @@
 # include "vector_utils.hh"
 # include "date_utils.hh"
 
+# include <map>
 # include <boost/filesystem.hpp>
 
 # pragma once
@@ -32,6 +33,21 @@ namespace Astroid {
       static Pango::Color tags_upper_color;
       static Pango::Color tags_lower_color;
 
+      /* tag colors are memoized by tag and canvas color, the version is
+       * incremented when they are cleared (config or plugins changed) so
+       * that users caching formatted tags may drop those as well. */
+      static void          clear_tag_colors ();
+      static unsigned long tag_colors_version;
+
+    private:
+      struct TagColors {
+        std::pair<Gdk::RGBA, Gdk::RGBA> rgba;
+        std::pair<ustring, ustring>     hex;
+      };
+
+      static std::map<std::pair<std::string, guint32>, TagColors> tag_colors;
+      static TagColors & lookup_tag_colors (ustring, guint8 canvascolor[3]);
+      static std::pair<Gdk::RGBA, Gdk::RGBA> make_tag_color_rgba (ustring, guint8 canvascolor[3]);
   };
 }
 
@@ -1,6 +1,7 @@
 # define BOOST_TEST_DYN_LINK
 # define BOOST_TEST_MODULE TestDates
 # include <boost/test/unit_test.hpp>
+# include <ctime>
 # include <gmime/gmime.h>
 # include "utils/gmime/gmime-compat.h"
 
@@ -107,5 +108,50 @@ BOOST_AUTO_TEST_SUITE(Dates)
   }
 
 
+  BOOST_AUTO_TEST_CASE(dates_pretty_cache)
+  {
+    setup ();
+
+    using Astroid::Date;
+
+    time_t now = time (NULL);
+    time_t expires;
+
+    /* relative dates expire when the label changes, or at midnight */
+    time_t t = now - 150;
+    ustring a = Date::pretty_print (t, expires);
+    LOG (test) << "pretty_print: " << a << ", expires in: " << (expires - now) << "s";
+
+    /* in the first minutes after midnight t is on the day before, and the
+     * label expires at the next midnight */
+    struct tm today;
+    localtime_r (&now, &today);
+    today.tm_hour = 0;
+    today.tm_min  = 0;
+    today.tm_sec  = 0;
+    today.tm_isdst = -1;
+    time_t midnight = mktime (&today);
+
+    BOOST_CHECK (expires > now);
+    if (t >= midnight) BOOST_CHECK (expires <= t + 180);
+
+    /* cached */
+    time_t expires_b;
+    ustring b = Date::pretty_print (t, expires_b);
+    BOOST_CHECK (a == b);
+    BOOST_CHECK (expires == expires_b);
+
+    /* absolute dates do not expire before midnight */
+    t = now - 400 * 24 * 60 * 60;
+    a = Date::pretty_print (t, expires);
+    LOG (test) << "pretty_print: " << a << ", expires in: " << (expires - now) << "s";
+
+    BOOST_CHECK (expires > now);
+    BOOST_CHECK (expires <= now + 25 * 60 * 60);
+
+    teardown ();
+  }
+
+
 BOOST_AUTO_TEST_SUITE_END()
 
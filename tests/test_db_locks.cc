@@ -0,0 +1,231 @@
+# define BOOST_TEST_DYN_LINK
+# define BOOST_TEST_MODULE TestDbLocks
+# include <boost/test/unit_test.hpp>
+
+# include <thread>
+# include <mutex>
+# include <atomic>
+# include <chrono>
+# include <vector>
+# include <functional>
+
+# include "test_common.hh"
+# include "db.hh"
+
+using Astroid::Db;
+
+/* the lock scheduling of Db, without opening the db. the thread running
+ * the tests is the gui thread (Db::init). */
+
+static void wait_a_bit () {
+  std::this_thread::sleep_for (std::chrono::milliseconds (200));
+}
+
+/* true if flag is set within a second */
+static bool becomes_set (std::atomic<bool> & flag) {
+  for (int i = 0; i < 100 && !flag; i++) {
+    std::this_thread::sleep_for (std::chrono::milliseconds (10));
+  }
+
+  return flag;
+}
+
+BOOST_AUTO_TEST_SUITE(DbLocks)
+
+  BOOST_AUTO_TEST_CASE(writers_in_order)
+  {
+    setup ();
+
+    unsigned long ro = Db::acquire_ro_lock ();
+
+    std::mutex m;
+    std::vector<int> order;
+
+    auto writer = [&] (int n) {
+      unsigned long id = Db::acquire_rw_lock ();
+
+      {
+        std::lock_guard<std::mutex> lk (m);
+        order.push_back (n);
+      }
+
+      Db::release_rw_lock (id);
+    };
+
+    std::thread w1 (writer, 1);
+    wait_a_bit ();
+    std::thread w2 (writer, 2);
+    std::thread w3;
+    wait_a_bit ();
+
+    {
+      /* waiting for the read-only lock */
+      std::lock_guard<std::mutex> lk (m);
+      BOOST_CHECK (order.empty ());
+    }
+
+    w3 = std::thread (writer, 3);
+    wait_a_bit ();
+
+    Db::release_ro_lock (ro);
+
+    w1.join ();
+    w2.join ();
+    w3.join ();
+
+    BOOST_CHECK ((order == std::vector<int> { 1, 2, 3 }));
+
+    teardown ();
+  }
+
+  BOOST_AUTO_TEST_CASE(readers_wait_for_waiting_writer)
+  {
+    setup ();
+
+    std::atomic<bool> loader_has_lock { false };
+    std::atomic<bool> loader_release  { false };
+
+    /* a long read-only lock of another thread, e.g. a query loader */
+    std::thread loader ([&] {
+        unsigned long id = Db::acquire_ro_lock ();
+        loader_has_lock = true;
+
+        while (!loader_release) std::this_thread::yield ();
+
+        Db::release_ro_lock (id);
+      });
+
+    BOOST_REQUIRE (becomes_set (loader_has_lock));
+
+    std::atomic<bool> writer_done { false };
+    std::thread writer ([&] {
+        unsigned long id = Db::acquire_rw_lock ();
+        writer_done = true;
+        Db::release_rw_lock (id);
+      });
+
+    wait_a_bit ();
+    BOOST_CHECK (!writer_done);
+
+    /* a reader on another thread waits for the writer */
+    std::atomic<bool> reader_has_lock { false };
+    bool reader_after_writer = false;
+
+    std::thread reader ([&] {
+        unsigned long id = Db::acquire_ro_lock ();
+        reader_after_writer = writer_done;
+        reader_has_lock = true;
+        Db::release_ro_lock (id);
+      });
+
+    wait_a_bit ();
+    BOOST_CHECK (!reader_has_lock);
+
+    /* the gui thread does not */
+    unsigned long gui = Db::acquire_ro_lock ();
+    BOOST_CHECK (!writer_done);
+    Db::release_ro_lock (gui);
+
+    loader_release = true;
+
+    loader.join ();
+    writer.join ();
+    reader.join ();
+
+    BOOST_CHECK (writer_done);
+    BOOST_CHECK (reader_has_lock);
+    BOOST_CHECK (reader_after_writer);
+
+    teardown ();
+  }
+
+  BOOST_AUTO_TEST_CASE(reentrant_reader)
+  {
+    setup ();
+
+    std::atomic<bool> has_first   { false };
+    std::atomic<bool> take_second { false };
+    std::atomic<bool> has_second  { false };
+
+    /* a thread that holds a read-only lock gets another while a writer
+     * is waiting for it */
+    std::thread reader ([&] {
+        unsigned long a = Db::acquire_ro_lock ();
+        has_first = true;
+
+        while (!take_second) std::this_thread::yield ();
+
+        unsigned long b = Db::acquire_ro_lock ();
+        has_second = true;
+
+        Db::release_ro_lock (b);
+        Db::release_ro_lock (a);
+      });
+
+    BOOST_REQUIRE (becomes_set (has_first));
+
+    std::atomic<bool> writer_done { false };
+    std::thread writer ([&] {
+        unsigned long id = Db::acquire_rw_lock ();
+        writer_done = true;
+        Db::release_rw_lock (id);
+      });
+
+    wait_a_bit ();
+    take_second = true;
+
+    BOOST_CHECK (becomes_set (has_second));
+
+    reader.join ();
+    writer.join ();
+
+    BOOST_CHECK (writer_done);
+
+    teardown ();
+  }
+
+  BOOST_AUTO_TEST_CASE(deadlocks)
+  {
+    setup ();
+
+    /* Boost.Test checks are made on the test thread */
+    bool rw_in_ro = false, ro_in_rw = false, rw_in_rw = false;
+
+    auto throws = [] (std::function<unsigned long ()> f) {
+      try {
+        f ();
+      } catch (Astroid::database_error &) {
+        return true;
+      }
+
+      return false;
+    };
+
+    std::thread t ([&] {
+        /* read-write while holding read-only */
+        unsigned long ro = Db::acquire_ro_lock ();
+        rw_in_ro = throws (Db::acquire_rw_lock);
+        Db::release_ro_lock (ro);
+
+        /* read-only while holding read-write */
+        unsigned long rw = Db::acquire_rw_lock ();
+        ro_in_rw = throws (Db::acquire_ro_lock);
+        rw_in_rw = throws (Db::acquire_rw_lock);
+        Db::release_rw_lock (rw);
+      });
+
+    t.join ();
+
+    BOOST_CHECK (rw_in_ro);
+    BOOST_CHECK (ro_in_rw);
+    BOOST_CHECK (rw_in_rw);
+
+    /* nothing is left held */
+    unsigned long rw = Db::acquire_rw_lock ();
+    Db::release_rw_lock (rw);
+
+    teardown ();
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
+
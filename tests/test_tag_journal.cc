@@ -0,0 +1,193 @@
+# define BOOST_TEST_DYN_LINK
+# define BOOST_TEST_MODULE TestTagJournal
+# include <boost/test/unit_test.hpp>
+# include <boost/filesystem.hpp>
+
+# include <fstream>
+# include <string>
+# include <vector>
+# include <algorithm>
+
+# include "test_common.hh"
+
+# include <notmuch.h>
+# include "db.hh"
+# include "actions/tag_journal.hh"
+
+namespace bfs = boost::filesystem;
+
+using Astroid::Db;
+using Astroid::TagJournal;
+using Astroid::ReplayAction;
+
+static std::vector<std::string> read_lines (bfs::path p) {
+  std::vector<std::string> lines;
+  std::ifstream f (p.c_str ());
+  std::string l;
+
+  while (std::getline (f, l)) lines.push_back (l);
+
+  return lines;
+}
+
+static TagJournal::Entry make (bool thread, ustring item, std::vector<ustring> add, std::vector<ustring> remove) {
+  TagJournal::Entry e;
+  e.thread = thread;
+  e.item   = item;
+  e.add    = add;
+  e.remove = remove;
+  return e;
+}
+
+BOOST_AUTO_TEST_SUITE(TagJournalTests)
+
+  BOOST_AUTO_TEST_CASE(unfinished_entries)
+  {
+    setup ();
+
+    bfs::path file = bfs::temp_directory_path () / bfs::unique_path ("astroid-journal-%%%%-%%%%");
+
+    std::vector<TagJournal::Entry> es = {
+      make (true,  "0000000000000001", { "inbox", "todo" }, { "unread" }),
+      make (false, "a.b@example.com",  { }, { "inbox" }),
+      make (true,  "0000000000000003", { "spam" }, { }),
+    };
+
+    {
+      TagJournal j (file);
+      BOOST_CHECK (j.take_unfinished ().empty ());
+
+      for (auto & e : es) j.write (e);
+      j.sync ();
+
+      /* ids are given in order */
+      BOOST_CHECK (es[0].id < es[1].id && es[1].id < es[2].id);
+
+      j.done ({ es[1].id });
+      j.close ();
+    }
+
+    /* a crash while writing the last line */
+    {
+      std::ofstream f (file.c_str (), std::ios::app);
+      f << "+\t" << (es[2].id + 10) << "\tt";
+    }
+
+    {
+      TagJournal j (file);
+
+      auto un = j.take_unfinished ();
+      BOOST_REQUIRE_EQUAL (un.size (), 2UL);
+
+      /* format and parse round-trip */
+      for (unsigned int i = 0; i < un.size (); i++) {
+        auto & e = es[i == 0 ? 0 : 2];
+
+        BOOST_CHECK_EQUAL (un[i].id, e.id);
+        BOOST_CHECK_EQUAL (un[i].thread, e.thread);
+        BOOST_CHECK (un[i].item == e.item);
+        BOOST_CHECK (un[i].add == e.add);
+        BOOST_CHECK (un[i].remove == e.remove);
+      }
+
+      /* only once */
+      BOOST_CHECK (j.take_unfinished ().empty ());
+
+      /* the journal was rewritten with only the unfinished entries */
+      auto lines = read_lines (file);
+      BOOST_CHECK_EQUAL (lines.size (), 2UL);
+      for (auto & l : lines) BOOST_CHECK (l[0] == '+');
+
+      /* new entries do not get the ids of the old ones */
+      auto e = make (true, "0000000000000004", { "muted" }, { });
+      j.write (e);
+      j.sync ();
+      BOOST_CHECK (e.id > es[2].id);
+
+      /* the journal is truncated when all entries are done */
+      j.done ({ es[0].id, es[2].id, e.id });
+      j.close ();
+
+      BOOST_CHECK_EQUAL (bfs::file_size (file), 0UL);
+    }
+
+    {
+      TagJournal j (file);
+      BOOST_CHECK (j.take_unfinished ().empty ());
+      j.close ();
+    }
+
+    bfs::remove (file);
+
+    teardown ();
+  }
+
+  BOOST_AUTO_TEST_CASE(replay)
+  {
+    setup ();
+
+    ustring mid;
+
+    {
+      Db db (Db::DbMode::DATABASE_READ_ONLY);
+
+      notmuch_query_t * q = notmuch_query_create (db.nm_db, "*");
+      notmuch_messages_t * ms;
+
+      if (notmuch_query_search_messages (q, &ms) == NOTMUCH_STATUS_SUCCESS &&
+          notmuch_messages_valid (ms)) {
+        notmuch_message_t * m = notmuch_messages_get (ms);
+        mid = notmuch_message_get_message_id (m);
+        notmuch_message_destroy (m);
+      }
+
+      notmuch_query_destroy (q);
+    }
+
+    BOOST_REQUIRE (!mid.empty ());
+
+    auto has_tag = [&] (ustring tag) {
+      bool found = false;
+      Db db (Db::DbMode::DATABASE_READ_ONLY);
+
+      db.on_message (mid, [&] (notmuch_message_t * m) {
+          notmuch_tags_t * tags;
+          for (tags = notmuch_message_get_tags (m);
+               notmuch_tags_valid (tags);
+               notmuch_tags_move_to_next (tags)) {
+            if (tag == notmuch_tags_get (tags)) found = true;
+          }
+        });
+
+      return found;
+    };
+
+    BOOST_REQUIRE (!has_tag ("test-journal"));
+
+    {
+      Glib::RefPtr<ReplayAction> r (new ReplayAction ({ make (false, mid, { "test-journal" }, { }) }));
+
+      Db db (Db::DbMode::DATABASE_READ_WRITE);
+      BOOST_CHECK (r->doit (&db));
+      BOOST_CHECK_EQUAL (r->progress.load (), 1U);
+    }
+
+    BOOST_CHECK (has_tag ("test-journal"));
+
+    /* the changes are applied whatever the tags are */
+    {
+      Glib::RefPtr<ReplayAction> r (new ReplayAction ({
+            make (false, mid, { }, { "test-journal" }),
+            make (false, mid, { }, { "test-journal" }) }));
+
+      Db db (Db::DbMode::DATABASE_READ_WRITE);
+      BOOST_CHECK (r->doit (&db));
+    }
+
+    BOOST_CHECK (!has_tag ("test-journal"));
+
+    teardown ();
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
+
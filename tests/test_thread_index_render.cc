@@ -0,0 +1,198 @@
+# define BOOST_TEST_DYN_LINK
+# define BOOST_TEST_MODULE TestThreadIndexRender
+# include <boost/test/unit_test.hpp>
+
+# include <iostream>
+# include <vector>
+# include <chrono>
+
+# include <gtkmm.h>
+# include <notmuch.h>
+
+# include "test_common.hh"
+# include "db.hh"
+# include "modes/thread_index/thread_index_list_cell_renderer.hh"
+
+using std::cout;
+using std::endl;
+using Astroid::Db;
+using Astroid::NotmuchThread;
+
+/* the renderer of a thread index, without the plugins of one */
+class TestRenderer : public Astroid::ThreadIndexListCellRenderer {
+  public:
+    TestRenderer () : ThreadIndexListCellRenderer (NULL) { }
+
+    void draw (Glib::RefPtr<NotmuchThread> t,
+               const Cairo::RefPtr<Cairo::Context> & cr,
+               Gtk::Widget & widget,
+               const Gdk::Rectangle & area,
+               bool selected)
+    {
+      thread = t;
+      marked = false;
+
+      render (cr, widget, area, area,
+          selected ? Gtk::CELL_RENDERER_SELECTED : Gtk::CellRendererState (0));
+    }
+
+    /* the text of the cached tags layout of thread */
+    ustring cached_tags (Glib::RefPtr<NotmuchThread> t, bool selected) {
+      auto r = row_cache.find (std::make_pair (t->thread_id.raw (), selected));
+      if (r == row_cache.end () || !r->second.tags) return "";
+
+      return r->second.tags->get_text ();
+    }
+
+  protected:
+    bool plugin_format_tags (std::vector<ustring>, ustring, bool, ustring &) override {
+      return false;
+    }
+};
+
+/* draws the thread index rows of the test database repeatedly to an
+ * offscreen surface, first without the row cache then with a warm one. */
+
+BOOST_AUTO_TEST_SUITE(ThreadIndexRender)
+
+  BOOST_AUTO_TEST_CASE(render_rows)
+  {
+    setup ();
+
+    if (!gtk_init_check (NULL, NULL)) {
+      cout << "ti render: no display, skipping." << endl;
+      teardown ();
+      return;
+    }
+
+    std::vector<Glib::RefPtr<NotmuchThread>> threads;
+
+    Db db (Db::DbMode::DATABASE_READ_ONLY);
+
+    notmuch_query_t * q = notmuch_query_create (db.nm_db, "*");
+    notmuch_threads_t * nm_threads;
+
+    for (notmuch_status_t st = notmuch_query_search_threads (q, &nm_threads);
+         (st == NOTMUCH_STATUS_SUCCESS) && notmuch_threads_valid (nm_threads);
+         notmuch_threads_move_to_next (nm_threads)) {
+
+      notmuch_thread_t * t = notmuch_threads_get (nm_threads);
+      threads.push_back (Glib::RefPtr<NotmuchThread> (new NotmuchThread (t)));
+      notmuch_thread_destroy (t);
+    }
+
+    notmuch_query_destroy (q);
+
+    BOOST_REQUIRE (threads.size () > 0);
+
+    Gtk::TreeView widget;
+    TestRenderer renderer;
+
+    const int rows   = 5000;
+    const int width  = 1200;
+    const int height = 40;
+
+    auto surface = Cairo::ImageSurface::create (Cairo::FORMAT_ARGB32, width, height);
+    auto cr      = Cairo::Context::create (surface);
+
+    Gdk::Rectangle area (0, 0, width, height);
+
+    for (int pass = 0; pass < 2; pass++) {
+      auto t0 = std::chrono::steady_clock::now ();
+
+      for (int i = 0; i < rows; i++) {
+        if (pass == 0) renderer.invalidate_cache ();
+
+        renderer.draw (threads[i % threads.size ()], cr, widget, area, (i % 10 == 0));
+      }
+
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - t0;
+
+      cout << "ti render: " << (pass == 0 ? "cold" : "warm") << ": "
+           << rows << " rows (" << threads.size () << " threads) in "
+           << elapsed.count () * 1000. << " ms, "
+           << (elapsed.count () * 1e6 / rows) << " us per row." << endl;
+    }
+
+    BOOST_CHECK (renderer.get_height () > 0);
+
+    threads.clear ();
+    db.close ();
+
+    teardown ();
+  }
+
+  BOOST_AUTO_TEST_CASE(replaced_thread)
+  {
+    /* a thread that is re-created, e.g. by a reload after its tags were
+     * changed outside astroid, is not drawn from the row of the thread it
+     * replaces. */
+    setup ();
+
+    if (!gtk_init_check (NULL, NULL)) {
+      cout << "ti render: no display, skipping." << endl;
+      teardown ();
+      return;
+    }
+
+    Db db (Db::DbMode::DATABASE_READ_ONLY);
+
+    auto load = [&] () {
+      Glib::RefPtr<NotmuchThread> t;
+
+      notmuch_query_t * q = notmuch_query_create (db.nm_db, "*");
+      notmuch_threads_t * nm_threads;
+
+      if (notmuch_query_search_threads (q, &nm_threads) == NOTMUCH_STATUS_SUCCESS &&
+          notmuch_threads_valid (nm_threads)) {
+        notmuch_thread_t * nmt = notmuch_threads_get (nm_threads);
+        t = Glib::RefPtr<NotmuchThread> (new NotmuchThread (nmt));
+        notmuch_thread_destroy (nmt);
+      }
+
+      notmuch_query_destroy (q);
+      return t;
+    };
+
+    Glib::RefPtr<NotmuchThread> first = load ();
+    BOOST_REQUIRE (first);
+
+    Gtk::TreeView widget;
+    TestRenderer renderer;
+
+    auto surface = Cairo::ImageSurface::create (Cairo::FORMAT_ARGB32, 1200, 40);
+    auto cr      = Cairo::Context::create (surface);
+    Gdk::Rectangle area (0, 0, 1200, 40);
+
+    renderer.draw (first, cr, widget, area, false);
+    BOOST_CHECK_EQUAL (renderer.rows_built, 1UL);
+    BOOST_CHECK (renderer.cached_tags (first, false).find ("a-test-changed") == ustring::npos);
+
+    /* unchanged: from the cache */
+    renderer.draw (first, cr, widget, area, false);
+    BOOST_CHECK_EQUAL (renderer.rows_built, 1UL);
+
+    /* the same thread, loaded again and changed */
+    Glib::RefPtr<NotmuchThread> second = load ();
+    BOOST_REQUIRE (second);
+    BOOST_REQUIRE (second->thread_id == first->thread_id);
+
+    /* sorted before the other tags, so that it is not cut off */
+    second->apply_tags ({ "a-test-changed" }, { });
+
+    renderer.draw (second, cr, widget, area, false);
+    BOOST_CHECK_EQUAL (renderer.rows_built, 2UL);
+    BOOST_CHECK (renderer.cached_tags (second, false).find ("a-test-changed") != ustring::npos);
+
+    renderer.draw (second, cr, widget, area, false);
+    BOOST_CHECK_EQUAL (renderer.rows_built, 2UL);
+
+    first.reset ();
+    second.reset ();
+    db.close ();
+
+    teardown ();
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
+
@@ -0,0 +1,185 @@
+# define BOOST_TEST_DYN_LINK
+# define BOOST_TEST_MODULE TestThreadIndexStore
+# include <boost/test/unit_test.hpp>
+
+# include <vector>
+
+# include <gtkmm.h>
+# include <notmuch.h>
+
+# include "test_common.hh"
+# include "db.hh"
+# include "modes/thread_index/thread_index_list_store.hh"
+
+using Astroid::Db;
+using Astroid::NotmuchThread;
+using Astroid::ThreadIndexListStore;
+
+BOOST_AUTO_TEST_SUITE(ThreadIndexStore)
+
+  BOOST_AUTO_TEST_CASE(store_rows)
+  {
+    setup ();
+
+    std::vector<Glib::RefPtr<NotmuchThread>> threads;
+
+    {
+      Db db (Db::DbMode::DATABASE_READ_ONLY);
+
+      notmuch_query_t * q = notmuch_query_create (db.nm_db, "*");
+      notmuch_threads_t * nm_threads;
+
+      for (notmuch_status_t st = notmuch_query_search_threads (q, &nm_threads);
+           (st == NOTMUCH_STATUS_SUCCESS) && notmuch_threads_valid (nm_threads);
+           notmuch_threads_move_to_next (nm_threads)) {
+
+        notmuch_thread_t * t = notmuch_threads_get (nm_threads);
+        threads.push_back (Glib::RefPtr<NotmuchThread> (new NotmuchThread (t)));
+        notmuch_thread_destroy (t);
+      }
+
+      notmuch_query_destroy (q);
+    }
+
+    BOOST_REQUIRE (threads.size () > 2);
+
+    /* distinct dates, in reverse order so that the store has to sort
+     * them */
+    for (unsigned int i = 0; i < threads.size (); i++) {
+      threads[i]->newest_date = 1000 + i;
+    }
+
+    Glib::RefPtr<ThreadIndexListStore> store (new ThreadIndexListStore ());
+    store->set_sort (ThreadIndexListStore::SortNewest);
+    store->append (threads);
+
+    BOOST_CHECK_EQUAL (store->size (), threads.size ());
+    BOOST_CHECK_EQUAL (store->total_size (), threads.size ());
+
+    for (unsigned int i = 0; i < store->size (); i++) {
+      auto it = store->iter_at (i);
+
+      BOOST_CHECK (store->get_thread (it) == threads[threads.size () - 1 - i]);
+      BOOST_CHECK_EQUAL (store->get_path (it)[0], (int) i);
+    }
+
+    BOOST_CHECK (!store->iter_at (store->size ()));
+
+    /* filter */
+    store->set_visible_func ([] (const Glib::RefPtr<NotmuchThread> & t) {
+        return (t->newest_date % 2) == 0;
+      });
+    store->refilter ();
+
+    BOOST_CHECK_EQUAL (store->size (), (threads.size () + 1) / 2);
+    BOOST_CHECK_EQUAL (store->total_size (), threads.size ());
+
+    for (unsigned int i = 0; i < store->size (); i++) {
+      BOOST_CHECK ((store->get_thread (store->iter_at (i))->newest_date % 2) == 0);
+    }
+
+    /* a changed thread moves to its sorted position */
+    auto last = threads[0];
+    last->newest_date = 5000;
+    store->update (last);
+
+    BOOST_CHECK (store->get_thread (store->iter_at (0)) == last);
+
+    /* marks follow the thread */
+    store->set_marked (store->iter_at (0), true);
+    BOOST_CHECK (store->get_marked (store->iter_at (0)));
+
+    last->newest_date = 1;
+    store->update (last);
+
+    BOOST_CHECK (store->get_thread (store->iter_at (store->size () - 1)) != last);
+
+    store->set_visible_func (ThreadIndexListStore::SlotVisible ());
+    store->refilter ();
+
+    BOOST_CHECK_EQUAL (store->size (), threads.size ());
+    BOOST_CHECK (store->get_thread (store->iter_at (store->size () - 1)) == last);
+    BOOST_CHECK (store->get_marked (store->iter_at (store->size () - 1)));
+
+    BOOST_CHECK (store->find (last->thread_id) == last);
+
+    /* sort in memory */
+    for (unsigned int i = 0; i < threads.size (); i++) {
+      threads[i]->oldest_date = threads[i]->newest_date;
+    }
+
+    store->set_sort (ThreadIndexListStore::SortOldest);
+    store->resort ();
+
+    BOOST_CHECK (store->get_thread (store->iter_at (0)) == last);
+    BOOST_CHECK (store->get_marked (store->iter_at (0)));
+
+    for (unsigned int i = 1; i < store->size (); i++) {
+      BOOST_CHECK (store->get_thread (store->iter_at (i - 1))->oldest_date <=
+                   store->get_thread (store->iter_at (i))->oldest_date);
+    }
+
+    store->set_sort (ThreadIndexListStore::SortMessages);
+    store->resort ();
+
+    for (unsigned int i = 1; i < store->size (); i++) {
+      BOOST_CHECK (store->get_thread (store->iter_at (i - 1))->total_messages >=
+                   store->get_thread (store->iter_at (i))->total_messages);
+    }
+
+    /* bulk marking */
+    store->toggle_marked_all ();
+    BOOST_CHECK_EQUAL (store->marked_count (), threads.size () - 1);
+    BOOST_CHECK (!store->get_marked (store->iter_at (0)));
+
+    store->set_visible_func ([&] (const Glib::RefPtr<NotmuchThread> & t) {
+        return t != last;
+      });
+    store->refilter ();
+
+    BOOST_CHECK_EQUAL (store->get_marked_threads ().size (), threads.size () - 1);
+
+    store->set_visible_func (ThreadIndexListStore::SlotVisible ());
+    store->refilter ();
+
+    store->toggle_marked_all ();
+    BOOST_CHECK_EQUAL (store->marked_count (), 1);
+
+    store->erase (last);
+    BOOST_CHECK_EQUAL (store->size (), threads.size () - 1);
+    BOOST_CHECK (!store->find (last->thread_id));
+    BOOST_CHECK_EQUAL (store->marked_count (), 0);
+
+    store->clear ();
+    BOOST_CHECK_EQUAL (store->size (), 0);
+    BOOST_CHECK_EQUAL (store->total_size (), 0);
+
+    /* a batch that is not in order is merged into the loaded rows */
+    std::vector<Glib::RefPtr<NotmuchThread>> even, odd;
+
+    for (unsigned int i = 0; i < threads.size (); i++) {
+      threads[i]->newest_date = 1000 + i;
+
+      if (i % 2 == 0) even.insert (even.begin (), threads[i]);
+      else            odd.push_back (threads[i]);
+    }
+
+    store->set_sort (ThreadIndexListStore::SortNewest);
+    store->append (even);
+    store->append (odd);
+
+    BOOST_CHECK_EQUAL (store->size (), threads.size ());
+
+    for (unsigned int i = 0; i < store->size (); i++) {
+      BOOST_CHECK (store->get_thread (store->iter_at (i)) == threads[threads.size () - 1 - i]);
+    }
+
+    store->clear ();
+
+    threads.clear ();
+
+    teardown ();
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
+